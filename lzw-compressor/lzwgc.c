@@ -1,147 +1,585 @@
 
 #include "lzwgc.h"
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// statistics; when they are not built in, the arguments are still read
+// so that counters kept only for them do not draw unused warnings
+#ifdef LZWGC_STATS
+#include "lzwgc_thread.h"
+#include <time.h>
+#define stat_add(dict, field, n) ((dict)->stats.field += (n))
+#define stat_max(dict, field, n) ((dict)->stats.field = ((dict)->stats.field < (n)) ? (n) : (dict)->stats.field)
+#define stat_probe(dict, n) ((dict)->stats.probes[((n) < LZWGC_STATS_PROBES) ? ((n) - 1) : (LZWGC_STATS_PROBES - 1)] += 1)
+#else
+#define stat_add(dict, field, n) ((void)(n))
+#define stat_max(dict, field, n) ((void)(n))
+#define stat_probe(dict, n) ((void)(n))
+#endif
 
 token_t token(uint32_t ix) { return 256 + ix; }
-uint32_t index(token_t tok) { return tok - 256; }
-bool valid_token(lzwgc_dict* dict, token_t tok) {
-    return (tok < dict->size) &&
-        ((tok < 256) ||
-         (tok != dict->prev_token[index(tok)]));
-}
+uint32_t index_of(token_t tok) { return tok - 256; }
 uint32_t hash_sc(token_t t, unsigned char c) {
     return ((c << 23) + (t << 11) + (c << 7) + t) * 16180319;
 }
+
+// a slot packs the string key beside its token, so probes compare keys
+// without touching the entry arrays. the byte above the token is the
+// distance from the key's home slot (255 saturates). 0 is empty.
+uint64_t const ht_key_mask = 0xffffffff00000000ull;
+uint64_t ht_key(token_t s, unsigned char c) {
+    return ((uint64_t)((s << 8) | c)) << 32;
+}
+token_t ht_token(uint64_t slot) {
+    return (token_t)(slot & 0xffffff);
+}
+uint32_t ht_index(lzwgc_dict* dict, token_t s, unsigned char c) {
+    return hash_sc(s, c) >> dict->ht_shift; // multiplicative hash; high bits mix best
+}
+uint32_t ht_dist(lzwgc_dict* dict, uint64_t slot, uint32_t ix) {
+    uint32_t const d = (uint32_t)(slot >> 24) & 0xff;
+    if (d < 255) return d;
+    uint32_t const key = (uint32_t)(slot >> 32);
+    return (ix - ht_index(dict, key >> 8, (unsigned char)key)) & (dict->ht_size - 1);
+}
+uint64_t ht_with_dist(uint64_t slot, uint32_t d) {
+    return (slot & ~(0xffull << 24)) | ((uint64_t)((d < 255) ? d : 255) << 24);
+}
+
+// a dictionary lives in one arena: the entry arrays, the hashtable and
+// any buffers its owner asks for, each part aligned to a cache line.
+// huge pages are only worth a syscall for big arenas.
+#define arena_align 64
+#define arena_huge  (2 << 20)
+static bool huge_pages = false;
+
+bool lzwgc_huge_pages(bool on) {
+#if defined(__linux__) || defined(_WIN32)
+    huge_pages = on;
+    return on;
+#else
+    (void)on;
+    return false;
+#endif
+}
+
+size_t arena_part(size_t* at, size_t bytes) {
+    size_t const off = (*at);
+    (*at) = (off + bytes + arena_align - 1) & ~(size_t)(arena_align - 1);
+    return off;
+}
+
+// explicit huge pages need some reserved by the administrator (linux)
+// or the lock pages privilege (windows). on linux, failing that, we ask
+// for transparent ones.
+void arena_alloc(lzwgc_dict* dict, size_t bytes) {
+    dict->arena = 0;
+    dict->arena_size = bytes;
+    dict->arena_mapped = false;
+#if defined(__linux__)
+    if (huge_pages && (bytes >= arena_huge)) {
+        size_t const len = (bytes + arena_huge - 1) & ~(size_t)(arena_huge - 1);
+        void * p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+        if (MAP_FAILED == p) {
+            p = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+            if (MAP_FAILED != p) madvise(p, len, MADV_HUGEPAGE);
+#endif
+        }
+        if (MAP_FAILED != p) {
+            dict->arena = p;
+            dict->arena_size = len;
+            dict->arena_mapped = true;
+            return;
+        }
+    }
+#elif defined(_WIN32)
+    size_t const page = GetLargePageMinimum();
+    if (huge_pages && (0 != page) && (bytes >= page)) {
+        size_t const len = (bytes + page - 1) & ~(page - 1);
+        void * const p = VirtualAlloc(0, len, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (0 != p) {
+            dict->arena = p;
+            dict->arena_size = len;
+            dict->arena_mapped = true;
+            return;
+        }
+    }
+#endif
+#ifdef _WIN32
+    dict->arena = _aligned_malloc(bytes, arena_align);
+#else
+    void * p;
+    dict->arena = (0 == posix_memalign(&p, arena_align, bytes)) ? p : 0;
+#endif
+}
+
+void arena_free(lzwgc_dict* dict) {
+    if (0 == dict->arena)
+        return;
+#if defined(__linux__)
+    if (dict->arena_mapped) munmap(dict->arena, dict->arena_size);
+    else free(dict->arena);
+#elif defined(_WIN32)
+    if (dict->arena_mapped) VirtualFree(dict->arena, 0, MEM_RELEASE);
+    else _aligned_free(dict->arena);
+#else
+    free(dict->arena);
+#endif
+    dict->arena = 0;
+}
+
 void lzwgc_dict_hashtable_add(lzwgc_dict* dict, token_t const s, unsigned char const c, token_t const loc);
 void lzwgc_dict_hashtable_rem(lzwgc_dict* dict, token_t const s, unsigned char const c, token_t const loc);
-void lzwgc_dict_hashtable_clean_if_saturated(lzwgc_dict* dict);
 void lzwgc_dict_hashtable_rebuild(lzwgc_dict* dict);
+void lzwgc_decompress_hist_init(lzwgc_decompress* st);
+
+// code walking the entries is compiled once per common width, with the
+// size a constant and the entry arrays as narrow as it allows, and once
+// for any other size. tokens and list links of up to 2^16 entries fit
+// 16 bits, and of up to 2^24 fit 24, packed as three bytes. clock match
+// counts stay below twice the entries (each sweep halves them, and a
+// token credits an entry at most once between sweeps), so they fit 16
+// bits only up to 2^15 entries and 24 bits up to 2^23; lazy lifts and
+// child counts stay within the same bound.
+#define lru_chances 8 // entries with children skipped per allocation, at most
+
+typedef struct { unsigned char b[3]; } u24;
+
+static uint32_t get16(uint16_t const* a, uint32_t ix) { return a[ix]; }
+static uint32_t get32(uint32_t const* a, uint32_t ix) { return a[ix]; }
+static uint32_t get24(u24 const* a, uint32_t ix) {
+    uint16_t lo;
+    memcpy(&lo, a[ix].b, sizeof(lo));
+    return lo | ((uint32_t)a[ix].b[2] << 16);
+}
+static void set16(uint16_t* a, uint32_t ix, uint32_t v) { a[ix] = (uint16_t)v; }
+static void set32(uint32_t* a, uint32_t ix, uint32_t v) { a[ix] = v; }
+static void set24(u24* a, uint32_t ix, uint32_t v) {
+    uint16_t const lo = (uint16_t)v;
+    memcpy(a[ix].b, &lo, sizeof(lo));
+    a[ix].b[2] = (unsigned char)(v >> 16);
+}
 
-void lzwgc_dict_init(lzwgc_dict* dict, uint32_t size) {
+#define W(name) name##_12
+#define W_SIZE ((1u << 12) - 1)
+#define entry_t uint16_t
+#define entry_get get16
+#define entry_set set16
+#define count_t uint16_t
+#define count_get get16
+#define count_set set16
+#include "lzwgc_width.h"
+
+#define W(name) name##_16
+#define W_SIZE ((1u << 16) - 1)
+#define entry_t uint16_t
+#define entry_get get16
+#define entry_set set16
+#define count_t uint32_t
+#define count_get get32
+#define count_set set32
+#include "lzwgc_width.h"
+
+#define W(name) name##_20
+#define W_SIZE ((1u << 20) - 1)
+#define entry_t u24
+#define entry_get get24
+#define entry_set set24
+#define count_t u24
+#define count_get get24
+#define count_set set24
+#include "lzwgc_width.h"
+
+#define W(name) name##_24
+#define W_SIZE ((1u << 24) - 1)
+#define entry_t u24
+#define entry_get get24
+#define entry_set set24
+#define count_t uint32_t
+#define count_get get32
+#define count_set set32
+#include "lzwgc_width.h"
+
+#define W(name) name##_any
+#define W_SIZE (dict->size)
+#define entry_t u24
+#define entry_get get24
+#define entry_set set24
+#define count_t uint32_t
+#define count_get get32
+#define count_set set32
+#include "lzwgc_width.h"
+
+// the copy of `fn` compiled for the dictionary's width
+#define by_width(dict, fn, args) \
+    ((12 == (dict)->width) ? fn##_12 args : \
+     (16 == (dict)->width) ? fn##_16 args : \
+     (20 == (dict)->width) ? fn##_20 args : \
+     (24 == (dict)->width) ? fn##_24 args : fn##_any args)
+
+uint32_t dict_width(uint32_t size) {
+    for (uint32_t w = 12; w <= 24; w += 4) {
+        if (size == ((1u << w) - 1)) return w;
+    }
+    return 0;
+}
+size_t entry_bytes(lzwgc_dict const* dict) {
+    return ((12 == dict->width) || (16 == dict->width)) ? sizeof(uint16_t) : sizeof(u24);
+}
+size_t count_bytes(lzwgc_dict const* dict) {
+    return (12 == dict->width) ? sizeof(uint16_t) :
+           (20 == dict->width) ? sizeof(u24) : sizeof(uint32_t);
+}
+
+// one element of an entry array stored `bytes` wide
+uint32_t elem_get(void const* a, size_t bytes, uint32_t ix) {
+    return (sizeof(uint16_t) == bytes) ? get16((uint16_t const*)a, ix) :
+           (sizeof(u24) == bytes) ? get24((u24 const*)a, ix) : get32((uint32_t const*)a, ix);
+}
+void elem_set(void* a, size_t bytes, uint32_t ix, uint32_t v) {
+    if (sizeof(uint16_t) == bytes) set16((uint16_t*)a, ix, v);
+    else if (sizeof(u24) == bytes) set24((u24*)a, ix, v);
+    else set32((uint32_t*)a, ix, v);
+}
+
+bool valid_token(lzwgc_dict const* dict, token_t tok) {
+    return by_width(dict, valid, (dict, tok));
+}
+void dict_clear(lzwgc_dict* dict, uint32_t lo, uint32_t hi) {
+    by_width(dict, clear, (dict, lo, hi));
+}
+void count_children(lzwgc_dict* dict) {
+    by_width(dict, count_children, (dict));
+}
+
+token_t lzwgc_dict_prev(lzwgc_dict const* dict, uint32_t ix) {
+    return elem_get(dict->prev_token, entry_bytes(dict), ix);
+}
+uint32_t lzwgc_dict_count(lzwgc_dict const* dict, uint32_t ix) {
+    return elem_get(dict->match_count, count_bytes(dict), ix);
+}
+uint32_t lzwgc_dict_lru_next(lzwgc_dict const* dict, uint32_t ix) {
+    return elem_get(dict->lru_next, entry_bytes(dict), ix);
+}
+
+void lzwgc_dict_set_prev(lzwgc_dict* dict, uint32_t ix, token_t prev) {
+    assert(prev < dict->size);
+    elem_set(dict->prev_token, entry_bytes(dict), ix, prev);
+}
+bool lzwgc_dict_set_count(lzwgc_dict* dict, uint32_t ix, uint32_t n) {
+    size_t const cb = count_bytes(dict);
+    if ((cb < sizeof(uint32_t)) && ((n >> (8 * cb)) != 0)) return false;
+    elem_set(dict->match_count, cb, ix, n);
+    return true;
+}
+void lzwgc_dict_set_lru_next(lzwgc_dict* dict, uint32_t ix, uint32_t next) {
+    size_t const eb = entry_bytes(dict);
+    elem_set(dict->lru_next, eb, ix, next);
+    elem_set(dict->lru_prev, eb, next, ix);
+}
+
+// `extra` bytes at the front of the arena are left to the caller
+void dict_init_arena(lzwgc_dict* dict, uint32_t size, uint32_t gc_policy, size_t extra) {
     assert(((1 << 8) <= size) && (size <= (1 << 24)));
-    uint32_t const dyn_size = index(size);
-    dict->match_count = malloc(dyn_size * sizeof(uint32_t));
-    dict->prev_token = malloc(dyn_size * sizeof(token_t));
-    dict->added_char = malloc(dyn_size * sizeof(unsigned char));
+    assert(gc_policy < LZWGC_GC_COUNT);
+    uint32_t const dyn_size = index_of(size);
+    bool const firsts = (LZWGC_GC_CLOCK != gc_policy);
+    bool const lru = (LZWGC_GC_LRU == gc_policy);
+
+    // hashtable at most half full
+    dict->ht_size = 1;
+    dict->ht_shift = 32;
+    while (dict->ht_size < (2 * size)) {
+        dict->ht_size *= 2;
+        dict->ht_shift -= 1;
+    }
+
+    dict->width = dict_width(size);
+    size_t const eb = entry_bytes(dict);
+    size_t at = 0;
+    arena_part(&at, extra);
+    size_t const match_count = arena_part(&at, dyn_size * count_bytes(dict));
+    size_t const prev_token = arena_part(&at, dyn_size * eb);
+    size_t const added_char = arena_part(&at, dyn_size * sizeof(unsigned char));
+    size_t const first_char = firsts ? arena_part(&at, dyn_size * sizeof(unsigned char)) : 0;
+    size_t const lru_next = lru ? arena_part(&at, (dyn_size + 1) * eb) : 0;
+    size_t const lru_prev = lru ? arena_part(&at, (dyn_size + 1) * eb) : 0;
+    size_t const ht = arena_part(&at, (size_t)dict->ht_size * sizeof(uint64_t));
+    arena_alloc(dict, at);
+    assert(0 != dict->arena);
+
+    dict->match_count = dict->arena + match_count;
+    dict->prev_token = dict->arena + prev_token;
+    dict->added_char = dict->arena + added_char;
+    dict->first_char = firsts ? (dict->arena + first_char) : 0;
+    dict->lru_next = lru ? (dict->arena + lru_next) : 0;
+    dict->lru_prev = lru ? (dict->arena + lru_prev) : 0;
+    dict->child_count = 0;
     dict->alloc_idx = (dyn_size - 1);  // begin allocating at 0,
     dict->hist_token = size; // special case: no history yet
     dict->size = size;
-    assert(0 != dict->match_count);
-    assert(0 != dict->prev_token);
-    assert(0 != dict->added_char);
-    for (uint32_t ii = 0; ii < dyn_size; ++ii) {
-        dict->match_count[ii] = 0;
-        dict->prev_token[ii] = token(ii); // init to invalid token
-        dict->added_char[ii] = 0;
-    }
+    dict->gc_policy = gc_policy;
+    dict->orphans = 0;
+    dict->used = 0;
+    dict_clear(dict, 0, dyn_size);
 
     // hashtable is lazily constructed on first lookup
-    dict->ht_size = 0;
-    dict->ht_sat = 0;
+    dict->ht_space = (uint64_t*)(dict->arena + ht);
     dict->ht_data = 0;
+
+#ifdef LZWGC_STATS
+    memset(&(dict->stats), 0, sizeof(dict->stats));
+#endif
+}
+
+void lzwgc_dict_init(lzwgc_dict* dict, uint32_t size) {
+    lzwgc_dict_init_gc(dict, size, LZWGC_GC_CLOCK);
+}
+
+void lzwgc_dict_init_gc(lzwgc_dict* dict, uint32_t size, uint32_t gc_policy) {
+    dict_init_arena(dict, size, gc_policy, 0);
 }
 
 bool lzwgc_dict_lookup(lzwgc_dict* dict, token_t s, unsigned char c, token_t* out) {
 
     // build dictionary on first lookup
     if (0 == dict->ht_data) {
-        dict->ht_size = 2 * dict->size;
-        dict->ht_sat = 0;
-        dict->ht_data = malloc(dict->ht_size * sizeof(token_t));
-        assert(0 != dict->ht_data);
+        dict->ht_data = dict->ht_space;
         lzwgc_dict_hashtable_rebuild(dict);
     }
 
-    // lookup entries from hashtable until we hit a match or a 0
-    uint32_t const ht_size = dict->ht_size;
-    uint32_t ix = hash_sc(s, c) % ht_size;
-    while (0 != dict->ht_data[ix]) {
-        token_t const tok = dict->ht_data[ix];
-        ix = (ix + 1) % ht_size;
-        if (tok < 256)
-            continue; // entry was deleted
-        uint32_t const tx = index(tok);
-        if ((dict->added_char[tx] == c) && (dict->prev_token[tx] == s)) {
-            (*out) = tok;
+    // no string extends an invalid token (e.g. before the first byte)
+    if (s >= dict->size) {
+        (*out) = dict->size;
+        return false;
+    }
+
+    // lookup entries from hashtable until we hit a match, a 0, or an
+    // entry closer to its home than we are to ours (robin hood order)
+    uint64_t const * const ht = dict->ht_data;
+    uint32_t const mask = dict->ht_size - 1;
+    uint64_t const key = ht_key(s, c);
+    uint32_t ix = ht_index(dict, s, c);
+    uint32_t dist = 0;
+    stat_add(dict, lookups, 1);
+    while (0 != ht[ix]) {
+        uint64_t const slot = ht[ix];
+        if ((slot & ht_key_mask) == key) {
+            stat_add(dict, found, 1);
+            stat_probe(dict, dist + 1);
+            (*out) = ht_token(slot);
             return true;
         }
+        if (dist > ht_dist(dict, slot, ix))
+            break;
+        ix = (ix + 1) & mask;
+        dist += 1;
     }
+    stat_probe(dict, dist + 1);
     (*out) = dict->size;
     return false;
 }
 
 
 void lzwgc_dict_update(lzwgc_dict* dict, token_t tok) {
-    token_t const tok_received = tok;
+    by_width(dict, update, (dict, tok));
+}
 
-    // special case: this is first token; invalid history
-    bool const this_is_first_token = (dict->hist_token == dict->size);
-    if (this_is_first_token) {
-        dict->hist_token = tok_received;
-        return;
-    }
+token_t lzwgc_dict_rank(lzwgc_dict const* dict, token_t tok) {
+    if ((tok < 256) || (tok >= dict->size))
+        return tok;
+    uint32_t const ix = index_of(tok);
+    uint32_t const a = dict->alloc_idx;
+    return token((a >= ix) ? (a - ix) : (a + index_of(dict->size) - ix));
+}
 
-    // increment match counts
-    while (tok >= 256) {
-        uint32_t const ix = index(tok);
-        dict->match_count[ix] += 1;
-        tok = dict->prev_token[ix];
-    }
-    unsigned char const first_char_of_tok_received = tok;
+uint32_t lzwgc_dict_readrev(lzwgc_dict* dict, token_t tok, unsigned char* sr, uint32_t size) {
+    return by_width(dict, readrev, (dict, tok, sr, size));
+}
 
-    // collect an entry for allocation
-    uint32_t const ii_max = index(dict->size);
-    uint32_t ii = dict->alloc_idx;
-    while (1) {
-        ii = (ii + 1) % ii_max;
-        if (0 == dict->match_count[ii])
-            break;
-        dict->match_count[ii] /= 2;
-    }
-    dict->alloc_idx = ii;
+#ifdef LZWGC_STATS
 
-    lzwgc_dict_hashtable_rem(dict, dict->prev_token[ii], dict->added_char[ii], token(ii));
+static lzwgc_once stats_once = LZWGC_ONCE_INIT;
+static lzwgc_mutex stats_lock;
+static lzwgc_stats stats_sum; // of finalized dictionaries
 
-    dict->prev_token[ii] = dict->hist_token;
-    dict->added_char[ii] = first_char_of_tok_received;
-    dict->hist_token = tok_received;
+static void stats_init(void) {
+    lzwgc_mutex_init(&stats_lock);
+}
 
-    lzwgc_dict_hashtable_add(dict, dict->prev_token[ii], dict->added_char[ii], token(ii));
-    lzwgc_dict_hashtable_clean_if_saturated(dict);
+static void stats_merge(lzwgc_stats* dst, lzwgc_stats const* src) {
+    dst->lookups += src->lookups;
+    dst->found += src->found;
+    for (uint32_t ii = 0; ii < LZWGC_STATS_PROBES; ++ii)
+        dst->probes[ii] += src->probes[ii];
+    dst->shifts += src->shifts;
+    dst->rebuilds += src->rebuilds;
+    dst->rebuild_ns += src->rebuild_ns;
+    dst->updates += src->updates;
+    dst->evictions += src->evictions;
+    dst->sweep += src->sweep;
+    if (dst->sweep_max < src->sweep_max) dst->sweep_max = src->sweep_max;
+    dst->chain += src->chain;
+    if (dst->chain_max < src->chain_max) dst->chain_max = src->chain_max;
 }
 
-uint32_t lzwgc_dict_readrev(lzwgc_dict* dict, token_t tok, unsigned char* sr, uint32_t size) {
-    if (tok > dict->size) return 0;
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ((uint64_t)ts.tv_sec * 1000000000u) + (uint64_t)ts.tv_nsec;
+}
 
-    uint32_t ct = 0;
-    while ((tok >= 256) && (ct < size)) {
-        uint32_t const ix = index(tok);
-        sr[ct++] = dict->added_char[ix];
-        tok = dict->prev_token[ix];
-    }
-    if (ct < size)
-        sr[ct++] = (unsigned char)tok;
-    return ct;
+#endif
+
+bool lzwgc_dict_stats(lzwgc_dict const* dict, lzwgc_stats* out) {
+#ifdef LZWGC_STATS
+    (*out) = dict->stats;
+    return true;
+#else
+    (void)dict;
+    memset(out, 0, sizeof(*out));
+    return false;
+#endif
+}
+
+bool lzwgc_stats_total(lzwgc_stats* out) {
+#ifdef LZWGC_STATS
+    lzwgc_call_once(&stats_once, stats_init);
+    lzwgc_mutex_lock(&stats_lock);
+    (*out) = stats_sum;
+    lzwgc_mutex_unlock(&stats_lock);
+    return true;
+#else
+    memset(out, 0, sizeof(*out));
+    return false;
+#endif
+}
+
+// a dictionary's statistics join the process totals when it is
+// finalized or reset, as one more dictionary
+void stats_retire(lzwgc_dict* dict) {
+#ifdef LZWGC_STATS
+    lzwgc_call_once(&stats_once, stats_init);
+    lzwgc_mutex_lock(&stats_lock);
+    stats_merge(&stats_sum, &(dict->stats));
+    lzwgc_mutex_unlock(&stats_lock);
+    memset(&(dict->stats), 0, sizeof(dict->stats));
+#else
+    (void)dict;
+#endif
 }
 
 void lzwgc_dict_fini(lzwgc_dict* dict) {
-    free(dict->match_count); dict->match_count = 0;
-    free(dict->prev_token);  dict->prev_token = 0;
-    free(dict->added_char);  dict->added_char = 0;
-    free(dict->ht_data);     dict->ht_data = 0;
+    if (0 != dict->arena) // not already finalized
+        stats_retire(dict);
+    arena_free(dict);
+    dict->match_count = 0;
+    dict->prev_token = 0;
+    dict->added_char = 0;
+    dict->first_char = 0;
+    dict->lru_next = 0;
+    dict->lru_prev = 0;
+    dict->ht_space = 0;
+    dict->ht_data = 0;
+    free(dict->child_count); dict->child_count = 0;
+}
+
+// entries and GC state of src, which has the same size and policy
+void dict_copy_entries(lzwgc_dict* dst, lzwgc_dict const* src) {
+    uint32_t const dyn_size = index_of(src->size);
+    size_t const eb = entry_bytes(src);
+    memcpy(dst->match_count, src->match_count, dyn_size * count_bytes(src));
+    memcpy(dst->prev_token, src->prev_token, dyn_size * eb);
+    memcpy(dst->added_char, src->added_char, dyn_size * sizeof(unsigned char));
+    if (0 != dst->first_char)
+        memcpy(dst->first_char, src->first_char, dyn_size * sizeof(unsigned char));
+    if (0 != dst->lru_next) {
+        memcpy(dst->lru_next, src->lru_next, (dyn_size + 1) * eb);
+        memcpy(dst->lru_prev, src->lru_prev, (dyn_size + 1) * eb);
+    }
+    dst->hist_token = src->hist_token;
+    dst->alloc_idx = src->alloc_idx;
+    dst->used = dyn_size; // as far as a reset can tell
+}
+
+void dict_copy_arena(lzwgc_dict* dst, lzwgc_dict const* src, size_t extra) {
+    dict_init_arena(dst, src->size, src->gc_policy, extra);
+    dict_copy_entries(dst, src);
+}
+
+// copy starts dst with the same entries and GC state as src. the
+// hashtable and any history bookkeeping are rebuilt on demand.
+void lzwgc_dict_copy(lzwgc_dict* dst, lzwgc_dict const* src) {
+    dict_copy_arena(dst, src, 0);
+}
+
+// the hashtable holds only entries that were allocated, so a chunk that
+// used few of them empties it faster by removing those than by clearing
+// the whole table on the next lookup.
+#define ht_reset_ratio 16
+
+void lzwgc_dict_reset(lzwgc_dict* dict, lzwgc_dict const* preset) {
+    uint32_t const dyn_size = index_of(dict->size);
+    uint32_t const used = dict->used;
+    stats_retire(dict);
+
+    if (0 != preset) {
+        assert((preset->size == dict->size) && (preset->gc_policy == dict->gc_policy));
+        dict_copy_entries(dict, preset);
+        dict->ht_data = 0;
+        if (0 != dict->child_count) count_children(dict);
+    } else {
+        if ((0 != dict->ht_data) && (used < (dyn_size / ht_reset_ratio))) {
+            by_width(dict, unhash, (dict, used));
+        } else {
+            dict->ht_data = 0;
+        }
+
+        // past the allocated entries, lru relinked the next one in line
+        // and the last one, as it took entries off the end of the list
+        uint32_t const hi = (used < dyn_size) ? (used + 1) : dyn_size;
+        dict_clear(dict, 0, hi);
+        if (hi < dyn_size) dict_clear(dict, dyn_size - 1, dyn_size);
+        dict->alloc_idx = (dyn_size - 1);
+        dict->hist_token = dict->size;
+        dict->used = 0;
+    }
+    dict->orphans = 0;
 }
 
 void lzwgc_compress_init(lzwgc_compress* st, uint32_t size) {
-    lzwgc_dict_init(&(st->dict), size);
+    lzwgc_compress_init_gc(st, size, LZWGC_GC_CLOCK);
+}
+
+void lzwgc_compress_init_gc(lzwgc_compress* st, uint32_t size, uint32_t gc_policy) {
+    lzwgc_dict_init_gc(&(st->dict), size, gc_policy);
     st->matched_token = size; // invalid token to start
+    st->ranked = false;
 
                               // no output at start
     st->have_output = false;
     st->token_output = size;
 }
 
+// a preset starts a new stream, so it has no previous token.
+void lzwgc_compress_init_dict(lzwgc_compress* st, lzwgc_dict const* preset) {
+    lzwgc_dict_copy(&(st->dict), preset);
+    st->dict.hist_token = preset->size;
+    st->matched_token = preset->size;
+    st->ranked = false;
+    st->have_output = false;
+    st->token_output = preset->size;
+}
+
 void lzwgc_compress_recv(lzwgc_compress* st, unsigned char c) {
     token_t const s = st->matched_token;
     token_t token_found;
@@ -155,37 +593,92 @@ void lzwgc_compress_recv(lzwgc_compress* st, unsigned char c) {
 
     // otherwise emit output and begin next match
     st->have_output = (s < st->dict.size);
-    st->token_output = s;
+    st->token_output = st->ranked ? lzwgc_dict_rank(&(st->dict), s) : s;
     st->matched_token = (token_t)c;
 
     // update the dictionary after each output
     if (st->have_output) {
-        lzwgc_dict_update(&(st->dict), st->token_output);
+        lzwgc_dict_update(&(st->dict), s);
     }
 }
 
+// the pending match goes out like any other token, updating the
+// dictionary as the decompressor will when it arrives. the next byte
+// then starts a new match, exactly as after the first byte of input.
+void lzwgc_compress_flush(lzwgc_compress* st) {
+    token_t const s = st->matched_token;
+    st->have_output = (s < st->dict.size);
+    st->token_output = st->ranked ? lzwgc_dict_rank(&(st->dict), s) : s;
+    st->matched_token = st->dict.size;
+    if (st->have_output) {
+        lzwgc_dict_update(&(st->dict), s);
+    }
+}
+
+// flush first: a reset drops the pending match.
+void lzwgc_compress_reset(lzwgc_compress* st, lzwgc_dict const* preset) {
+    lzwgc_dict_reset(&(st->dict), preset);
+    st->dict.hist_token = st->dict.size;
+    st->matched_token = st->dict.size;
+    st->have_output = false;
+    st->token_output = st->dict.size;
+}
+
 // unless input was empty, we should have a final output.
 void lzwgc_compress_fini(lzwgc_compress* st) {
-    st->have_output = (st->matched_token < st->dict.size);
-    st->token_output = st->matched_token;
+    token_t const s = st->matched_token;
+    st->have_output = (s < st->dict.size);
+    st->token_output = st->ranked ? lzwgc_dict_rank(&(st->dict), s) : s;
     lzwgc_dict_fini(&(st->dict));
 }
 
 
+void lzwgc_decompress_init_buffers(lzwgc_decompress* st);
+
+// the string buffers go at the front of the dictionary arena
+size_t decompress_buffers(uint32_t size, size_t* srbuff, size_t* output_chars) {
+    size_t at = 0;
+    (*srbuff) = arena_part(&at, size * sizeof(unsigned char));
+    (*output_chars) = arena_part(&at, size * sizeof(unsigned char));
+    return at;
+}
+
 void lzwgc_decompress_init(lzwgc_decompress* st, uint32_t size) {
-    lzwgc_dict_init(&(st->dict), size);
+    lzwgc_decompress_init_gc(st, size, LZWGC_GC_CLOCK);
+}
+
+void lzwgc_decompress_init_gc(lzwgc_decompress* st, uint32_t size, uint32_t gc_policy) {
+    size_t sr, oc;
+    dict_init_arena(&(st->dict), size, gc_policy, decompress_buffers(size, &sr, &oc));
+    lzwgc_decompress_init_buffers(st);
+}
 
-    size_t const szBuff = size * sizeof(unsigned char);
-    st->srbuff = malloc(szBuff);
-    assert(0 != st->srbuff);
+void lzwgc_decompress_init_dict(lzwgc_decompress* st, lzwgc_dict const* preset) {
+    size_t sr, oc;
+    dict_copy_arena(&(st->dict), preset, decompress_buffers(preset->size, &sr, &oc));
+    st->dict.hist_token = preset->size;
+    lzwgc_decompress_init_buffers(st);
+}
 
+void lzwgc_decompress_init_buffers(lzwgc_decompress* st) {
+    size_t sr, oc;
+    decompress_buffers(st->dict.size, &sr, &oc);
+    st->srbuff = st->dict.arena + sr;
     st->output_count = 0;
-    st->output_chars = malloc(szBuff);
-    assert(0 != st->output_chars);
+    st->output_chars = st->dict.arena + oc;
+
+    // history is allocated by the first lzwgc_decompress_hist
+    st->hist = 0;
+    st->last_off = 0;
+    st->last_len = 0;
+    st->last_stamp = 0;
+    st->ranked = false;
 }
 
 // decompress will validate the input token for security reasons.
 void lzwgc_decompress_recv(lzwgc_decompress* st, token_t tok) {
+    if (st->ranked) tok = lzwgc_dict_rank(&(st->dict), tok);
+
     // validate input for safety
     bool const valid_input_token = valid_token(&(st->dict), tok);
     assert(valid_input_token);
@@ -202,81 +695,142 @@ void lzwgc_decompress_recv(lzwgc_decompress* st, token_t tok) {
     lzwgc_dict_update(&(st->dict), tok);
 }
 
+// history records are only kept for entries allocated since the last
+// reset, as are child counts, so only those are cleared.
+void lzwgc_decompress_reset(lzwgc_decompress* st, lzwgc_dict const* preset) {
+    uint32_t const used = st->dict.used;
+    lzwgc_dict_reset(&(st->dict), preset);
+    st->dict.hist_token = st->dict.size;
+    st->output_count = 0;
+    if (0 != st->hist) memset(st->hist, 0, used * sizeof(lzwgc_hist));
+    st->last_off = 0;
+    st->last_len = 0;
+    st->last_stamp = 0;
+}
+
 void lzwgc_decompress_fini(lzwgc_decompress* st) {
     lzwgc_dict_fini(&(st->dict));
     st->output_count = 0;
-    free(st->srbuff); st->srbuff = 0;
-    free(st->output_chars); st->output_chars = 0;
+    st->srbuff = 0;
+    st->output_chars = 0;
+    free(st->hist); st->hist = 0;
 }
 
+size_t lzwgc_compress_block(lzwgc_compress* st, unsigned char const* in, size_t count,
+                            token_t* out, size_t cap, size_t* consumed) {
+    return by_width(&(st->dict), compress_block, (st, in, count, out, cap, consumed));
+}
+
+size_t lzwgc_decompress_block(lzwgc_decompress* st, token_t const* in, size_t count,
+                              unsigned char* out, size_t cap, size_t* consumed) {
+    return by_width(&(st->dict), decompress_block, (st, in, count, out, cap, consumed));
+}
+
+void lzwgc_decompress_hist_init(lzwgc_decompress* st) {
+    lzwgc_dict * const dict = &(st->dict);
+    uint32_t const dyn_size = index_of(dict->size);
+    assert(dict->hist_token == dict->size); // nothing decoded yet
+
+    st->hist = calloc(dyn_size, sizeof(lzwgc_hist));
+    assert(0 != st->hist);
+    if ((LZWGC_GC_LRU != dict->gc_policy) && (0 == dict->child_count)) {
+        // a preset may already have entries extending others
+        dict->child_count = malloc(dyn_size * count_bytes(dict));
+        assert(0 != dict->child_count);
+        count_children(dict);
+    }
+}
+
+size_t lzwgc_decompress_hist(lzwgc_decompress* st, token_t const* in, size_t count,
+                             unsigned char* out, size_t pos, size_t cap, size_t* consumed) {
+    return by_width(&(st->dict), decompress_hist, (st, in, count, out, pos, cap, consumed));
+}
 
 
 
 // declare string s+c to be stored as token `loc`
+// entries further from home take the slot of those nearer to theirs,
+// which keeps probe sequences short without ever rebuilding the table.
 void lzwgc_dict_hashtable_add(lzwgc_dict* dict, token_t const s, unsigned char const c, token_t const loc) {
     assert(loc >= 256);
     if (0 == dict->ht_data)
         return;
 
-    uint32_t const ht_size = dict->ht_size;
-    uint32_t ix = hash_sc(s, c) % ht_size;
+    uint32_t const mask = dict->ht_size - 1;
+    uint64_t entry = ht_key(s, c) | loc;
+    uint32_t ix = ht_index(dict, s, c);
+    uint32_t dist = 0;
     while (1) {
-        token_t const tok = dict->ht_data[ix];
-        if (0 == tok) {
-            dict->ht_data[ix] = loc;
-            dict->ht_sat += 1; //
-            break;
-        } else if (1 == tok) {
-            dict->ht_data[ix] = loc;
-            // no extra saturation (replacing deleted entry)
+        uint64_t const slot = dict->ht_data[ix];
+        if (0 == slot) {
+            dict->ht_data[ix] = ht_with_dist(entry, dist);
             break;
         }
-        ix = (ix + 1) % ht_size; // collision
-    }
-}
-
-void lzwgc_dict_hashtable_clean_if_saturated(lzwgc_dict* dict) {
-    // a reasonable limit for this table is 80% saturation
-    bool const saturated = ((5 * dict->ht_sat) > (4 * dict->ht_size));
-    if (saturated) {
-        lzwgc_dict_hashtable_rebuild(dict);
+        uint32_t const slot_dist = ht_dist(dict, slot, ix);
+        if (slot_dist < dist) {
+            dict->ht_data[ix] = ht_with_dist(entry, dist);
+            entry = slot;
+            dist = slot_dist;
+        }
+        ix = (ix + 1) & mask; // collision
+        dist += 1;
     }
 }
 
+// only used to construct the table; with at most half the slots in use
+// and no tombstones, it never needs rebuilding afterwards. entries never
+// allocated (prev_token is their own token) are left out: no lookup can
+// reach a string that extends itself, so a new table starts empty.
 void lzwgc_dict_hashtable_rebuild(lzwgc_dict* dict) {
     if (0 == dict->ht_data)
         return;
+#ifdef LZWGC_STATS
+    uint64_t const t0 = now_ns();
+#endif
 
     // clear the existing table
-    uint32_t const ht_size = dict->ht_size;
-    for (uint32_t ii = 0; ii < ht_size; ++ii) {
-        dict->ht_data[ii] = 0;
-    }
-    dict->ht_sat = 0;
+    memset(dict->ht_data, 0, (size_t)dict->ht_size * sizeof(uint64_t));
 
     // rebuild the table from scratch
-    uint32_t const dyn_size = index(dict->size);
-    for (uint32_t ii = 0; ii < dyn_size; ++ii) {
-        token_t const s = dict->prev_token[ii];
-        unsigned char const c = dict->added_char[ii];
-        token_t const loc = token(ii);
-        lzwgc_dict_hashtable_add(dict, s, c, loc);
-    }
+    by_width(dict, rehash, (dict));
+#ifdef LZWGC_STATS
+    dict->stats.rebuilds += 1;
+    dict->stats.rebuild_ns += now_ns() - t0;
+#endif
 }
 
+// remove by shifting the rest of the cluster back one slot, so a
+// removal costs no more than the cluster it sits in.
 void lzwgc_dict_hashtable_rem(lzwgc_dict* dict, token_t const s, unsigned char const c, token_t const loc) {
     assert(loc >= 256);
     if (0 == dict->ht_data)
         return;
 
-    uint32_t const ht_size = dict->ht_size;
-    uint32_t ix = hash_sc(s, c) % ht_size;
+    uint64_t * const ht = dict->ht_data;
+    uint32_t const mask = dict->ht_size - 1;
+    uint32_t ix = ht_index(dict, s, c);
+    uint32_t dist = 0;
+
+    while (1) {
+        uint64_t const slot = ht[ix];
+        if ((0 == slot) || (dist > ht_dist(dict, slot, ix)))
+            return; // not present
+        if (loc == ht_token(slot))
+            break;
+        ix = (ix + 1) & mask;
+        dist += 1;
+    }
 
-    while (0 != dict->ht_data[ix]) {
-        if (loc == dict->ht_data[ix]) {
-            dict->ht_data[ix] = 1; // entry deleted, but allows collisions
+    while (1) {
+        uint32_t const next = (ix + 1) & mask;
+        uint64_t const slot = ht[next];
+        uint32_t const slot_dist = (0 == slot) ? 0 : ht_dist(dict, slot, next);
+        if (0 == slot_dist) {
+            ht[ix] = 0;
             break;
         }
-        ix = (ix + 1) % ht_size;
+        ht[ix] = ht_with_dist(slot, slot_dist - 1);
+        ix = next;
+        stat_add(dict, shifts, 1);
     }
 }
@@ -13,23 +13,84 @@
 #ifndef LZWGC_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef uint32_t token_t; // documentation some integers as tokens
 
+// GC policies decide how entries earn their place in the dictionary.
+// Both ends of a stream must use the same one; the container records it.
+#define LZWGC_GC_CLOCK  0 // credit every prefix of an emitted token
+#define LZWGC_GC_LAZY   1 // credit the emitted token; the sweep passes it on to prefixes
+#define LZWGC_GC_LRU    2 // collect the least recently emitted string, O(1) per token
+#define LZWGC_GC_COUNT  3 // number of policies
+
+// Dictionary statistics, counted only when the library is built with
+// LZWGC_STATS defined; otherwise the counters are not in lzwgc_dict and
+// the code maintaining them compiles to nothing.
+#define LZWGC_STATS_PROBES 16    // probe histogram buckets
+
+typedef struct
+{
+    uint64_t        lookups;     // lzwgc_dict_lookup calls past the first byte
+    uint64_t        found;       // of which matched
+    uint64_t        probes[LZWGC_STATS_PROBES]; // lookups by slots examined, 1 up;
+                                 // the last bucket holds longer probes too
+    uint64_t        shifts;      // slots moved back by removals. deletion never
+                                 // leaves tombstones; this is what it costs instead
+    uint64_t        rebuilds;    // hashtable rebuilds
+    uint64_t        rebuild_ns;  // wall-clock time spent in them
+    uint64_t        updates;     // tokens that allocated an entry
+    uint64_t        evictions;   // of which displaced an earlier string (turnover)
+    uint64_t        sweep;       // entries examined to find those entries
+    uint64_t        sweep_max;   // most for one allocation
+    uint64_t        chain;       // entries credited by the updates
+    uint64_t        chain_max;   // most for one token
+} lzwgc_stats;
+
+// Each dictionary is one allocation (arena) holding its entry arrays,
+// its hashtable and, for a decompressor, its string buffers. Memory for
+// the hashtable is only touched by lookups, so decompressors leave it
+// unmapped. With huge pages on, arenas of 2MB and up are asked of the OS
+// on huge pages (transparent ones on linux, if none are reserved), and
+// fall back to ordinary memory. Returns false where this build has no
+// huge pages. Call it before any threads use the library.
+bool lzwgc_huge_pages(bool on);
+
 typedef struct
 {
     uint32_t        size;        // size of dictionary
-    uint32_t      * match_count; // slice of match counts
-    token_t       * prev_token;  // previously matched
+    uint32_t        width;       // 12, 16, 20 or 24 if size is 2^width - 1, else 0;
+                                 // picks the code and element types used below
+    void          * match_count; // slice of match counts (child counts for lru GC)
+    void          * prev_token;  // previously matched
     unsigned char * added_char;  // character matched
+    unsigned char * first_char;  // first character of the string (lazy and lru GC)
+    void          * lru_next;    // recency list toward least recent (lru GC only);
+    void          * lru_prev;    // one extra slot at the end holds the list head
+    void          * child_count; // entries extending each entry (history decode only)
+    uint32_t        orphans;     // reallocations of an entry with children
     token_t         hist_token;  // last token in update stream 
     uint32_t        alloc_idx;   // last index allocated
+    uint32_t        used;        // entries allocated since init or reset; the
+                                 // rest are as init left them
+    uint32_t        gc_policy;   // LZWGC_GC_*
+
+    unsigned char * arena;       // the arrays above but child_count, the
+    size_t          arena_size;  // hashtable and any buffers of the owner
+    bool            arena_mapped; // from the OS (huge pages), not malloc
 
                                  // hashtable is constructed on first lzwgc_dict_lookup
-    token_t *       ht_data;     // tokens to search 
-    uint32_t        ht_size;     // space for hashtable
-    uint32_t        ht_sat;      // number of filled locations
+                                 // robin hood with backward shift deletion (no tombstones)
+                                 // slots hold key << 32 | probe distance << 24 | token
+    uint64_t *      ht_space;    // hashtable memory in the arena
+    uint64_t *      ht_data;     // keys and tokens to search; ht_space once built
+    uint32_t        ht_size;     // space for hashtable (power of two)
+    uint32_t        ht_shift;    // 32 - log2(ht_size), to index by high hash bits
+
+#ifdef LZWGC_STATS
+    lzwgc_stats     stats;
+#endif
 } lzwgc_dict;
 
 typedef struct
@@ -37,6 +98,7 @@ typedef struct
     // internal state
     lzwgc_dict      dict;
     token_t         matched_token;
+    bool            ranked;      // output allocation ranks; false unless set after init
 
     // output after each operation (at most one token)
     bool            have_output;
@@ -44,11 +106,27 @@ typedef struct
 } lzwgc_compress;
 
 
+// where a string was last written in the output; valid while stamp
+// matches dict.orphans
+typedef struct
+{
+    size_t          off;
+    uint32_t        len;         // 0 if unknown
+    uint32_t        stamp;
+} lzwgc_hist;
+
 typedef struct
 {
     // internal state
     lzwgc_dict      dict;
     unsigned char * srbuff;
+    bool            ranked;      // input is allocation ranks; false unless set after init
+
+    // history decode, one per entry; allocated on first use
+    lzwgc_hist    * hist;
+    size_t          last_off;    // output of the previous token
+    uint32_t        last_len;
+    uint32_t        last_stamp;  // dict.orphans when it was written
 
     // output after each operation (a number of characters)
     uint32_t        output_count;
@@ -56,25 +134,93 @@ typedef struct
 } lzwgc_decompress;
 
 void lzwgc_dict_init(lzwgc_dict*, uint32_t size); // size from 2^8 to 2^24
+void lzwgc_dict_init_gc(lzwgc_dict*, uint32_t size, uint32_t gc_policy);
 void lzwgc_dict_update(lzwgc_dict*, token_t); // update from token stream
 bool lzwgc_dict_lookup(lzwgc_dict*, token_t s, unsigned char c, token_t* out);
 void lzwgc_dict_fini(lzwgc_dict*); // clear memory from dictionary
+void lzwgc_dict_copy(lzwgc_dict* dst, lzwgc_dict const* src); // dst uninitialized
+
+// reset empties the dictionary again, or makes it a copy of `preset`
+// (same size and GC policy), keeping its memory. Emptying only touches
+// the entries allocated since, so it costs what the last stream added,
+// not what the dictionary could hold.
+void lzwgc_dict_reset(lzwgc_dict*, lzwgc_dict const* preset);
+
+// Entries are stored as narrow as the dictionary's width allows: tokens
+// and list links in 16 bits up to 2^16 entries, else in 24 packed as
+// three bytes; counts in 16 bits at 12 bits wide, 24 at 20, else 32. Code outside the library reads and writes them
+// through these; set_count fails if the count does not fit, and
+// set_lru_next also sets the back link of `next`.
+token_t  lzwgc_dict_prev(lzwgc_dict const*, uint32_t ix);
+uint32_t lzwgc_dict_count(lzwgc_dict const*, uint32_t ix);
+uint32_t lzwgc_dict_lru_next(lzwgc_dict const*, uint32_t ix);
+void lzwgc_dict_set_prev(lzwgc_dict*, uint32_t ix, token_t prev);
+bool lzwgc_dict_set_count(lzwgc_dict*, uint32_t ix, uint32_t n);
+void lzwgc_dict_set_lru_next(lzwgc_dict*, uint32_t ix, uint32_t next);
 
                                    // fetch at most count elements (reversed)
 uint32_t lzwgc_dict_readrev(lzwgc_dict*, token_t, unsigned char*, uint32_t count);
 
+// allocation rank of a token: 256 for the entry allocated last, 257 for
+// the one before, and so on round the dictionary; literals and invalid
+// tokens are unchanged. Recent entries are emitted far more often than
+// old ones, which entropy coding can exploit (lzwgc_entropy.h). A rank
+// maps back to its token by the same function.
+token_t lzwgc_dict_rank(lzwgc_dict const*, token_t);
+
+// statistics of one dictionary so far, or of every dictionary finalized
+// so far in this process (e.g. by the chunk and parallel APIs). Both
+// return false, with zeroed stats, unless built with LZWGC_STATS.
+bool lzwgc_dict_stats(lzwgc_dict const*, lzwgc_stats*);
+bool lzwgc_stats_total(lzwgc_stats*);
+
 // Incremental API; element at a time
 // compress will receive bytes and output zero or one tokens
+// flush emits the partial match, if any, so the peer can decode every
+// byte received so far; the dictionary is kept and stays in step.
 // finalization will release memory and usually emits a final output.
 void lzwgc_compress_init(lzwgc_compress*, uint32_t size);
+void lzwgc_compress_init_gc(lzwgc_compress*, uint32_t size, uint32_t gc_policy);
+void lzwgc_compress_init_dict(lzwgc_compress*, lzwgc_dict const* preset); // see lzwgc_preset.h
 void lzwgc_compress_recv(lzwgc_compress*, unsigned char);
+void lzwgc_compress_flush(lzwgc_compress*);
 void lzwgc_compress_fini(lzwgc_compress*);
 
+// reset starts a new stream on the same state, with an empty dictionary
+// or a copy of `preset`, as init would but without allocating. `ranked`
+// is kept. Flush the last stream first; its pending match is dropped.
+void lzwgc_compress_reset(lzwgc_compress*, lzwgc_dict const* preset);
+
 // decompress will receive a token and output at least one byte
 // finalization will release memory, and in this case never has output.
 void lzwgc_decompress_init(lzwgc_decompress*, uint32_t size);
+void lzwgc_decompress_init_gc(lzwgc_decompress*, uint32_t size, uint32_t gc_policy);
+void lzwgc_decompress_init_dict(lzwgc_decompress*, lzwgc_dict const* preset);
 void lzwgc_decompress_recv(lzwgc_decompress*, token_t  tok);
 void lzwgc_decompress_fini(lzwgc_decompress*);
+void lzwgc_decompress_reset(lzwgc_decompress*, lzwgc_dict const* preset); // as lzwgc_compress_reset
+
+// Block API; buffer at a time
+// compress consumes bytes from `in` until input is exhausted or `cap`
+// tokens have been written to `out`. Returns the number of tokens written
+// and reports bytes consumed. The final token still comes from fini.
+size_t lzwgc_compress_block(lzwgc_compress*, unsigned char const* in, size_t count,
+                            token_t* out, size_t cap, size_t* consumed);
+
+// decompress consumes tokens until input is exhausted or the next token
+// would not fit in the `cap` bytes at `out`. Returns the number of bytes
+// written and reports tokens consumed. Stops early on an invalid token.
+size_t lzwgc_decompress_block(lzwgc_decompress*, token_t const* in, size_t count,
+                              unsigned char* out, size_t cap, size_t* consumed);
+
+// History API; whole output in one buffer
+// as the block API, but `out` holds all output since init: the first
+// `pos` bytes are what earlier calls wrote and new bytes go after them.
+// Strings are copied from where they last appeared instead of walking
+// the dictionary. Use it from the first token, and not mixed with the
+// other decompress calls on the same state.
+size_t lzwgc_decompress_hist(lzwgc_decompress*, token_t const* in, size_t count,
+                             unsigned char* out, size_t pos, size_t cap, size_t* consumed);
 
 #define LZWGC_H
 #endif
@@ -0,0 +1,221 @@
+
+
+#include "lzwgc_batch.h"
+#include "lzwgc_map.h"
+#include "lzwgc_thread.h"
+#include "lzwgc_compat.h"
+#include <stdlib.h>
+#include <assert.h>
+
+void lzwgc_batch_init(lzwgc_batch* b, lzwgc_pool* pool, lzwgc_par_opts const* opts) {
+    uint32_t const n = lzwgc_pool_size(pool);
+    lzwgc_header_init(&(b->hdr), opts->bits, opts->flags);
+    b->hdr.gc_policy = opts->gc_policy;
+    b->hdr.dict_id = (0 != opts->preset) ? opts->dict_id : 0;
+    b->preset = opts->preset;
+    b->pool = pool;
+    b->states = malloc(n * sizeof(lzwgc_chunk_state));
+    b->bufs = calloc(n, sizeof(lzwgc_batch_buf));
+    assert((0 != b->states) && (0 != b->bufs));
+    for (uint32_t ii = 0; ii < n; ++ii)
+        lzwgc_chunk_state_init(&(b->states[ii]));
+}
+
+void lzwgc_batch_fini(lzwgc_batch* b) {
+    uint32_t const n = lzwgc_pool_size(b->pool);
+    for (uint32_t ii = 0; ii < n; ++ii) {
+        lzwgc_chunk_state_fini(&(b->states[ii]));
+        free(b->bufs[ii].data);
+    }
+    free(b->states);
+    free(b->bufs);
+    b->states = 0;
+    b->bufs = 0;
+}
+
+// a container of one chunk for `m` in the worker's buffer; its length
+static size_t file_container(lzwgc_batch* b, uint32_t worker, lzwgc_map const* m) {
+    lzwgc_batch_buf * const buf = &(b->bufs[worker]);
+    size_t const bound = lzwgc_chunk_bound(&(b->hdr), m->size);
+    size_t const need = LZWGC_HEADER_SIZE + bound + lzwgc_index_size(1);
+    if (buf->cap < need) {
+        free(buf->data);
+        buf->data = malloc(need);
+        buf->cap = need;
+        assert(0 != buf->data);
+    }
+
+    lzwgc_chunk_entry e;
+    lzwgc_header_encode(&(b->hdr), buf->data);
+    lzwgc_chunk_compress_state(&(b->hdr), b->preset, &(b->states[worker]), m->data, m->size,
+                               buf->data + LZWGC_HEADER_SIZE, bound, &e);
+    e.offset = LZWGC_HEADER_SIZE;
+    lzwgc_index_encode(&e, 1, e.offset + e.comp_len, buf->data + e.offset + e.comp_len);
+    return (size_t)(e.offset + e.comp_len) + lzwgc_index_size(1);
+}
+
+typedef struct
+{
+    lzwgc_batch             * b;
+    char const * const      * in;
+    char const * const      * out;
+    bool                    * ok;       // one flag per file, no sharing
+} files_job;
+
+static void file_task(void* ctx, uint32_t worker, size_t ii) {
+    files_job * const job = ctx;
+    lzwgc_map m;
+    FILE * f;
+
+    bool ok = lzwgc_map_open(&m, job->in[ii], 0, 0, LZWGC_MAP_SEQUENTIAL);
+    if (ok) {
+        size_t const len = file_container(job->b, worker, &m);
+        lzwgc_map_close(&m);
+        ok = (0 != (f = lzwgc_fopen(job->out[ii], "wb")));
+        if (ok) {
+            ok = (fwrite(job->b->bufs[worker].data, 1, len, f) == len);
+            ok = (0 == fclose(f)) && ok;
+        }
+    }
+    job->ok[ii] = ok;
+}
+
+bool lzwgc_batch_files(lzwgc_batch* b, char const* const* in, char const* const* out,
+                       size_t count, bool* ok) {
+    files_job job;
+    job.b = b;
+    job.in = in;
+    job.out = out;
+    job.ok = (0 != ok) ? ok : malloc((count + 1) * sizeof(bool));
+    assert(0 != job.ok);
+
+    lzwgc_pool_run(b->pool, count, file_task, &job);
+
+    bool all = true;
+    for (size_t ii = 0; ii < count; ++ii)
+        all = all && job.ok[ii];
+    if (0 == ok) free(job.ok);
+    return all;
+}
+
+typedef struct
+{
+    lzwgc_batch             * b;
+    char const * const      * in;
+
+    // per file results, guarded by lock
+    unsigned char          ** out;
+    lzwgc_chunk_entry       * entries;
+    bool                    * ready;
+    bool                    * read;     // the file could be read
+    size_t                    delivered; // files handed to the sink
+    size_t                    window;   // files allowed past delivered
+    bool                      aborted;
+    lzwgc_mutex               lock;
+    lzwgc_cond                cv;
+} archive_job;
+
+// as compress_task in lzwgc_par.c, with a file per chunk
+static void archive_task(void* ctx, uint32_t worker, size_t ii) {
+    archive_job * const job = ctx;
+
+    lzwgc_mutex_lock(&(job->lock));
+    while (!job->aborted && (ii >= (job->delivered + job->window)))
+        lzwgc_cond_wait(&(job->cv), &(job->lock));
+    bool const aborted = job->aborted;
+    lzwgc_mutex_unlock(&(job->lock));
+
+    unsigned char * buf = 0;
+    bool read = false;
+    lzwgc_map m;
+    if (!aborted && lzwgc_map_open(&m, job->in[ii], 0, 0, LZWGC_MAP_SEQUENTIAL)) {
+        lzwgc_batch * const b = job->b;
+        size_t const cap = lzwgc_chunk_bound(&(b->hdr), m.size);
+        buf = malloc(cap);
+        assert(0 != buf);
+        lzwgc_chunk_compress_state(&(b->hdr), b->preset, &(b->states[worker]),
+                                   m.data, m.size, buf, cap, &(job->entries[ii]));
+        lzwgc_map_close(&m);
+        read = true;
+    }
+
+    lzwgc_mutex_lock(&(job->lock));
+    job->out[ii] = buf;
+    job->read[ii] = read;
+    job->ready[ii] = true;
+    lzwgc_cond_broadcast(&(job->cv));
+    lzwgc_mutex_unlock(&(job->lock));
+}
+
+bool lzwgc_batch_archive(lzwgc_batch* b, char const* const* in, size_t count,
+                         lzwgc_sink_fn sink, void* ctx, size_t* unread) {
+    assert(count <= UINT32_MAX);
+
+    archive_job job;
+    job.b = b;
+    job.in = in;
+    job.out = calloc(count + 1, sizeof(unsigned char*));
+    job.entries = calloc(count + 1, sizeof(lzwgc_chunk_entry));
+    job.ready = calloc(count + 1, sizeof(bool));
+    job.read = calloc(count + 1, sizeof(bool));
+    assert((0 != job.out) && (0 != job.entries) && (0 != job.ready) && (0 != job.read));
+    job.delivered = 0;
+    job.window = 2 * lzwgc_pool_size(b->pool);
+    job.aborted = false;
+    lzwgc_mutex_init(&(job.lock));
+    lzwgc_cond_init(&(job.cv));
+
+    unsigned char hbuf[LZWGC_HEADER_SIZE];
+    lzwgc_header_encode(&(b->hdr), hbuf);
+    bool all = sink(ctx, hbuf, LZWGC_HEADER_SIZE);
+    uint64_t pos = LZWGC_HEADER_SIZE;
+
+    size_t bad = count;
+    lzwgc_pool_start(b->pool, all ? count : 0, archive_task, &job);
+    for (size_t ii = 0; all && (ii < count); ++ii) {
+        lzwgc_mutex_lock(&(job.lock));
+        while (!job.ready[ii])
+            lzwgc_cond_wait(&(job.cv), &(job.lock));
+        lzwgc_mutex_unlock(&(job.lock));
+
+        if (job.read[ii]) {
+            job.entries[ii].offset = pos;
+            all = sink(ctx, job.out[ii], (size_t)job.entries[ii].comp_len);
+            pos += job.entries[ii].comp_len;
+        } else {
+            bad = ii; // its entry was never filled in
+            all = false;
+        }
+        free(job.out[ii]);
+        job.out[ii] = 0;
+
+        lzwgc_mutex_lock(&(job.lock));
+        job.delivered = ii + 1;
+        job.aborted = !all;
+        lzwgc_cond_broadcast(&(job.cv));
+        lzwgc_mutex_unlock(&(job.lock));
+    }
+    lzwgc_pool_wait(b->pool);
+
+    if (all) {
+        size_t const isz = lzwgc_index_size((uint32_t)count);
+        unsigned char * const ibuf = malloc(isz);
+        assert(0 != ibuf);
+        lzwgc_index_encode(job.entries, (uint32_t)count, pos, ibuf);
+        all = sink(ctx, ibuf, isz);
+        free(ibuf);
+    }
+
+    // files finished after an abort were never delivered
+    for (size_t ii = job.delivered; ii < count; ++ii)
+        free(job.out[ii]);
+    if (0 != unread) (*unread) = bad;
+
+    lzwgc_cond_fini(&(job.cv));
+    lzwgc_mutex_fini(&(job.lock));
+    free(job.out);
+    free(job.entries);
+    free(job.ready);
+    free(job.read);
+    return all;
+}
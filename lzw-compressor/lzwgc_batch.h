@@ -0,0 +1,56 @@
+/*
+* Batch compression of many small files on a thread pool.
+*
+* Compressing a small file on its own costs more in setup (a fresh
+* dictionary, opening streams) than in coding. A batch keeps one chunk
+* state and one output buffer per worker for as long as it lives, so
+* after the first file a worker only resets its dictionary. Workers
+* take files from the list in order, each file being one chunk.
+*
+* Results go either to a container per file, each what `lzwgc c -t`
+* writes for a file that is not empty and fits one chunk, or to one
+* archive: a container whose chunk i is file i of the list. The archive
+* keeps no names; the list given to lzwgc_batch_archive says which file
+* is which, and the raw lengths in the index where each one starts, so
+* an lzwgc_reader can fetch any of them alone.
+*/
+
+#ifndef LZWGC_BATCH_H
+
+#include "lzwgc_par.h"
+
+typedef struct
+{
+    unsigned char     * data;
+    size_t              cap;
+} lzwgc_batch_buf;
+
+typedef struct
+{
+    lzwgc_header        hdr;
+    lzwgc_dict const  * preset;
+    lzwgc_pool        * pool;
+    lzwgc_chunk_state * states;      // one per worker, kept across batches
+    lzwgc_batch_buf   * bufs;        // one per worker, for whole output files
+} lzwgc_batch;
+
+// init takes width, flags, policy and preset from opts; chunk_size is
+// unused, since every file is one chunk
+void lzwgc_batch_init(lzwgc_batch*, lzwgc_pool*, lzwgc_par_opts const*);
+void lzwgc_batch_fini(lzwgc_batch*);
+
+// files compresses in[i] to out[i] for every i below count. A file
+// that cannot be read or written does not stop the rest; ok (0 if not
+// wanted) records which succeeded. False if any failed.
+bool lzwgc_batch_files(lzwgc_batch*, char const* const* in, char const* const* out,
+                       size_t count, bool* ok);
+
+// archive delivers one container holding all of `in`, in order, to the
+// sink. False if the sink aborted or a file could not be read, either
+// of which ends the archive early; `unread` (0 if not wanted) is then
+// the file that could not be read, or count if none.
+bool lzwgc_batch_archive(lzwgc_batch*, char const* const* in, size_t count,
+                         lzwgc_sink_fn, void* ctx, size_t* unread);
+
+#define LZWGC_BATCH_H
+#endif
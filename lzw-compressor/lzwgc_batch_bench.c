@@ -0,0 +1,223 @@
+#include "lzwgc.h"
+#include "lzwgc_container.h"
+#include "lzwgc_batch.h"
+#include "lzwgc_map.h"
+#include "lzwgc_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define list_max 16
+#define name_max 4096
+
+static double now_us(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ((double)ts.tv_sec * 1e6) + ((double)ts.tv_nsec / 1e3);
+}
+
+// xorshift64, so every run sees the same input
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+// words from a fixed vocabulary, common ones far more often
+static void synth_text(unsigned char* b, size_t len) {
+    enum { vocab = 1024 };
+    static char words[vocab][10];
+    uint64_t s = 0x9e3779b97f4a7c15ull;
+    for (int w = 0; w < vocab; ++w) {
+        int const n = 2 + (int)(rnd(&s) % 8);
+        for (int k = 0; k < n; ++k) words[w][k] = (char)('a' + (rnd(&s) % 26));
+        words[w][n] = 0;
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        double const u = (double)(rnd(&s) >> 11) / (double)(1ull << 53);
+        char const * w = words[(int)(vocab * u * u)];
+        while ((pos < len) && (0 != *w)) b[pos++] = (unsigned char)*w++;
+        if (pos < len) b[pos++] = ' ';
+    }
+}
+
+static bool write_file(char const* path, unsigned char const* data, size_t len) {
+    FILE * const f = lzwgc_fopen(path, "wb");
+    if (0 == f) return false;
+    bool const ok = (fwrite(data, 1, len, f) == len);
+    return (0 == fclose(f)) && ok;
+}
+
+static bool write_sink(void* ctx, unsigned char const* data, size_t len) {
+    return (fwrite(data, 1, len, (FILE*)ctx) == len);
+}
+
+// each file on its own, as one `lzwgc c -t 1` per file would: a new
+// dictionary and new streams every time, on one thread
+static bool one_by_one(lzwgc_header const* h, char * const* in, char * const* out, uint32_t count) {
+    bool ok = true;
+    for (uint32_t ii = 0; ok && (ii < count); ++ii) {
+        lzwgc_map m;
+        lzwgc_chunk_entry e;
+        ok = lzwgc_map_open(&m, in[ii], 0, 0, LZWGC_MAP_SEQUENTIAL);
+        if (!ok) break;
+        size_t const bound = lzwgc_chunk_bound(h, m.size);
+        unsigned char * const buf = malloc(LZWGC_HEADER_SIZE + bound + lzwgc_index_size(1));
+        lzwgc_header_encode(h, buf);
+        lzwgc_chunk_compress(h, m.data, m.size, buf + LZWGC_HEADER_SIZE, bound, &e);
+        e.offset = LZWGC_HEADER_SIZE;
+        lzwgc_index_encode(&e, 1, e.offset + e.comp_len, buf + e.offset + e.comp_len);
+        ok = write_file(out[ii], buf, (size_t)(e.offset + e.comp_len) + lzwgc_index_size(1));
+        free(buf);
+        lzwgc_map_close(&m);
+    }
+    return ok;
+}
+
+/** LZW-GC batch benchmark:
+ *  lzwgc_batch_bench [-s size_kb ...] [-m total_mb] [-b bits] [-t threads] [-d dir] [file]
+ *  Writes files of each size (default 4, 16, 64, 256 and 1024 KB) into
+ *  dir (default the current directory), as many as make total_mb
+ *  (default 16) but at least 8, then compresses them three ways and
+ *  reports files per second: one by one with a new dictionary each, as
+ *  a separate lzwgc per file would; as a batch to a file each; and as a
+ *  batch to one archive, which is expanded again to check it. Batches
+ *  run on `threads` threads (default all cores). Input is cut from the
+ *  file, else generated text; the scratch files are removed afterwards.
+ */
+int main(int argc, char * argv[]) {
+    uint32_t sizes_kb[list_max];
+    uint32_t nsizes = 0;
+    uint32_t total_mb = 16;
+    uint32_t threads = 0;
+    lzwgc_par_opts opts;
+    char const * dir = ".";
+    char const * path = 0;
+
+    lzwgc_par_defaults(&opts);
+    for (int i = 1; i < argc; ++i) {
+        bool const more = (i + 1 < argc);
+        if (more && (0 == strcmp(argv[i], "-s")) && (nsizes < list_max)) sizes_kb[nsizes++] = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-m"))) total_mb = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-b"))) opts.bits = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-t"))) threads = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-d"))) dir = argv[++i];
+        else path = argv[i];
+    }
+    if (0 == nsizes) {
+        sizes_kb[nsizes++] = 4;
+        sizes_kb[nsizes++] = 16;
+        sizes_kb[nsizes++] = 64;
+        sizes_kb[nsizes++] = 256;
+        sizes_kb[nsizes++] = 1024;
+    }
+    if ((opts.bits < 9) || (opts.bits > 24)) {
+        printf("ERROR: Token width must be 9 to 24 bits.");
+        return -1;
+    }
+    uint32_t max_kb = 0;
+    for (uint32_t k = 0; k < nsizes; ++k) {
+        if ((0 == sizes_kb[k]) || (0 == total_mb)) {
+            printf("ERROR: Sizes must be positive.");
+            return -1;
+        }
+        if (sizes_kb[k] > max_kb) max_kb = sizes_kb[k];
+    }
+
+    // the largest set of files; smaller ones use a prefix
+    size_t const len = (((size_t)total_mb << 20) > ((size_t)max_kb << 13)) ? ((size_t)total_mb << 20)
+                                                                           : ((size_t)max_kb << 13);
+    unsigned char * const data = malloc(len);
+    unsigned char * const back = malloc(len);
+    if ((0 == data) || (0 == back)) {
+        printf("ERROR: Out of memory.");
+        return -1;
+    }
+    lzwgc_map map;
+    if (0 != path) {
+        if (!lzwgc_map_open(&map, path, 0, 0, LZWGC_MAP_SEQUENTIAL) || (0 == map.size)) {
+            printf("ERROR: Cannot read %s.", path);
+            return -1;
+        }
+        for (size_t pos = 0; pos < len; pos += map.size) // repeated to fill
+            memcpy(data + pos, map.data, ((len - pos) < map.size) ? (len - pos) : map.size);
+        lzwgc_map_close(&map);
+    } else {
+        synth_text(data, len);
+    }
+
+    lzwgc_pool * const pool = lzwgc_pool_create(threads);
+    lzwgc_batch b;
+    lzwgc_header hdr;
+    lzwgc_batch_init(&b, pool, &opts);
+    lzwgc_header_init(&hdr, opts.bits, opts.flags);
+
+    char arc[name_max];
+    snprintf(arc, name_max, "%s/lzwgc_batch_bench.arc", dir);
+    printf("%u threads\n", lzwgc_pool_size(pool));
+    printf("size_kb   files  one by one files/s  batch files/s  archive files/s\n");
+    bool ok = true;
+    for (uint32_t k = 0; ok && (k < nsizes); ++k) {
+        size_t const size = (size_t)sizes_kb[k] << 10;
+        size_t const fit = ((size_t)total_mb << 20) / size;
+        uint32_t const count = (fit < 8) ? 8 : (uint32_t)fit;
+        char ** const in = malloc(count * sizeof(char*));
+        char ** const out = malloc(count * sizeof(char*));
+        for (uint32_t ii = 0; ii < count; ++ii) {
+            in[ii] = malloc(name_max);
+            out[ii] = malloc(name_max);
+            snprintf(in[ii], name_max, "%s/lzwgc_batch_bench_%u", dir, ii);
+            snprintf(out[ii], name_max, "%s/lzwgc_batch_bench_%u.lzw", dir, ii);
+            if (ok && !write_file(in[ii], data + (ii * size), size)) {
+                printf("ERROR: Cannot write %s.", in[ii]);
+                ok = false;
+            }
+        }
+
+        double t0 = now_us();
+        ok = ok && one_by_one(&hdr, in, out, count);
+        double const single_us = now_us() - t0;
+
+        t0 = now_us();
+        ok = ok && lzwgc_batch_files(&b, (char const* const*)in, (char const* const*)out, count, 0);
+        double const batch_us = now_us() - t0;
+
+        FILE * f = 0;
+        t0 = now_us();
+        ok = ok && (0 != (f = lzwgc_fopen(arc, "wb")));
+        ok = ok && lzwgc_batch_archive(&b, (char const* const*)in, count, write_sink, f, 0);
+        if (0 != f) ok = (0 == fclose(f)) && ok;
+        double const archive_us = now_us() - t0;
+
+        if (ok) {
+            printf("%7u  %6u  %18.0f  %13.0f  %15.0f\n", sizes_kb[k], count,
+                   count * 1e6 / single_us, count * 1e6 / batch_us, count * 1e6 / archive_us);
+            ok = lzwgc_map_open(&map, arc, 0, 0, 0) &&
+                lzwgc_par_decompress(pool, map.data, map.size, back, len) &&
+                (0 == memcmp(data, back, count * size));
+            lzwgc_map_close(&map);
+            if (!ok) printf("ERROR: Round trip failed.\n");
+        } else {
+            printf("ERROR: Cannot compress the files in %s.\n", dir);
+        }
+
+        for (uint32_t ii = 0; ii < count; ++ii) {
+            remove(in[ii]);
+            remove(out[ii]);
+            free(in[ii]);
+            free(out[ii]);
+        }
+        remove(arc);
+        free(in);
+        free(out);
+    }
+
+    lzwgc_batch_fini(&b);
+    lzwgc_pool_destroy(pool);
+    free(data);
+    free(back);
+    return ok ? 0 : -1;
+}
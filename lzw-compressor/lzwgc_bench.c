@@ -0,0 +1,483 @@
+#include "lzwgc.h"
+#include "lzwgc_container.h"
+#include "lzwgc_map.h"
+#include "lzwgc_compat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define default_synth_kb 4096
+#define bits_min 9  // 2^8 dictionary entries past the literals
+#define bits_max 24 // 2^24
+
+typedef enum { format_text, format_csv, format_json } format_t;
+
+static char const * const policy_name[LZWGC_GC_COUNT] = { "clock", "lazy", "lru" };
+
+// how tokens are written: fixed width, or entropy coded (-e in lzwgc)
+enum { coding_fixed, coding_entropy, coding_count };
+static char const * const coding_name[coding_count] = { "fixed", "entropy" };
+
+// one input, either a mapped file or a generated corpus
+typedef struct {
+    char const          * name;
+    unsigned char const * data;
+    size_t                size;
+    lzwgc_map             map;
+    unsigned char       * synth;
+} corpus;
+
+// one policy and width over one corpus
+typedef struct {
+    double   ratio;
+    double   comp_mbps;
+    double   dec_mbps;
+    size_t   comp_peak_kb; // 0 where the OS gives no resettable peak
+    size_t   dec_peak_kb;
+    double   worst_us;
+    uint32_t worst_sweep;
+    size_t   slow[3];      // input bytes over 10us, 100us and 1ms
+} result;
+
+static double const slow_us[3] = { 10, 100, 1000 };
+
+static double seconds(clock_t t0) {
+    return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+static double mbps(size_t len, double secs) {
+    return (secs > 0) ? ((double)len / (1 << 20)) / secs : 0;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ((double)ts.tv_sec * 1e6) + ((double)ts.tv_nsec / 1e3);
+}
+
+#ifdef __linux__
+
+// field of /proc/self/status in kB, e.g. VmRSS or VmHWM
+static size_t status_kb(char const* field) {
+    char line[256];
+    size_t const n = strlen(field);
+    size_t kb = 0;
+    FILE * const f = lzwgc_fopen("/proc/self/status", "r");
+    if (0 == f) return 0;
+    while (0 != fgets(line, sizeof(line), f)) {
+        if ((0 == strncmp(line, field, n)) && (':' == line[n])) {
+            kb = strtoul(line + n + 1, 0, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// peak_reset sets the high water mark back to the current resident
+// size and returns that size; 0 if the kernel would not reset it.
+// Memory freed by the previous run is handed back first, or reusing it
+// would not show up as growth.
+static size_t peak_reset(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    FILE * const f = lzwgc_fopen("/proc/self/clear_refs", "w");
+    if (0 == f) return 0;
+    bool const ok = (EOF != fputs("5", f));
+    if ((EOF == fclose(f)) || !ok) return 0;
+    return status_kb("VmRSS");
+}
+
+// memory made resident since peak_reset
+static size_t peak_kb(size_t base) {
+    size_t const hwm = status_kb("VmHWM");
+    return ((0 != base) && (hwm > base)) ? hwm - base : 0;
+}
+
+#else
+
+static size_t peak_reset(void) { return 0; }
+static size_t peak_kb(size_t base) { (void)base; return 0; }
+
+#endif
+
+// xorshift64, so the corpora are the same on every run and platform
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+static void synth_random(unsigned char* b, size_t len, uint64_t* s) {
+    for (size_t ii = 0; ii < len; ++ii) b[ii] = (unsigned char)(rnd(s) >> 56);
+}
+
+// one random 4KB block over and over; matches grow without bound,
+// which is also the worst case for the clock sweep
+static void synth_repeat(unsigned char* b, size_t len, uint64_t* s) {
+    size_t const period = 1 << 12;
+    synth_random(b, (len < period) ? len : period, s);
+    for (size_t ii = period; ii < len; ++ii) b[ii] = b[ii - period];
+}
+
+// words from a fixed vocabulary, common ones far more often, in
+// sentences of a dozen or so words and lines of about 70 characters
+static void synth_text(unsigned char* b, size_t len, uint64_t* s) {
+    enum { vocab = 2048 };
+    static char words[vocab][10];
+    for (int w = 0; w < vocab; ++w) {
+        int const n = 2 + (int)(rnd(s) % 8);
+        for (int k = 0; k < n; ++k) words[w][k] = (char)('a' + (rnd(s) % 26));
+        words[w][n] = 0;
+    }
+
+    size_t pos = 0, line = 0;
+    bool cap = true;
+    while (pos < len) {
+        double const u = (double)(rnd(s) >> 11) / (double)(1ull << 53);
+        char const * w = words[(int)(vocab * u * u * u)];
+        while ((pos < len) && (0 != *w)) {
+            char c = *w++;
+            if (cap) { c = (char)(c - 'a' + 'A'); cap = false; }
+            b[pos++] = (unsigned char)c;
+            ++line;
+        }
+        if ((pos < len) && (0 == (rnd(s) % 12))) { b[pos++] = '.'; cap = true; }
+        if (pos < len) {
+            b[pos++] = (line > 70) ? '\n' : ' ';
+            if (line > 70) line = 0; else ++line;
+        }
+    }
+}
+
+// corpus_open maps a file, or generates ":random", ":repeat" or ":text"
+static bool corpus_open(corpus* c, char const* name, size_t synth_len) {
+    static struct { char const * name; void (*gen)(unsigned char*, size_t, uint64_t*); } const synth[] = {
+        { ":random", synth_random }, { ":repeat", synth_repeat }, { ":text", synth_text }
+    };
+    c->name = name;
+    c->synth = 0;
+    for (size_t ii = 0; ii < (sizeof(synth) / sizeof(synth[0])); ++ii) {
+        if (0 == strcmp(name, synth[ii].name)) {
+            uint64_t seed = 0x9e3779b97f4a7c15ull;
+            c->synth = malloc((synth_len > 0) ? synth_len : 1);
+            if (0 == c->synth) return false;
+            synth[ii].gen(c->synth, synth_len, &seed);
+            c->data = c->synth;
+            c->size = synth_len;
+            return true;
+        }
+    }
+    if (!lzwgc_map_open(&(c->map), name, 0, 0, LZWGC_MAP_SEQUENTIAL)) return false;
+    c->data = c->map.data;
+    c->size = c->map.size;
+    return true;
+}
+
+static void corpus_close(corpus* c) {
+    if (0 != c->synth) free(c->synth);
+    else lzwgc_map_close(&(c->map));
+}
+
+// latency times every lzwgc_compress_recv, i.e. the cost charged to
+// the one byte that ends a match, including its dictionary update: the
+// worst, and how many bytes took over each of slow_us. A stall such as
+// rebuilding the hashtable shows as a worst case far above the rest.
+// For the clock based policies it also reports the longest sweep,
+// which is how far alloc_idx moved; lru never looks at more than a
+// handful.
+static void latency(unsigned char const* in, size_t len, uint32_t bits, uint32_t policy, result* r) {
+    lzwgc_compress st;
+    token_t tok;
+    lzwgc_compress_init_gc(&st, (1 << bits) - 1, policy);
+    lzwgc_dict_lookup(&(st.dict), 0, 0, &tok); // build the hashtable up front
+
+    uint32_t const n = st.dict.size - 256;
+    r->worst_us = 0;
+    r->worst_sweep = 0;
+    for (uint32_t k = 0; k < 3; ++k) r->slow[k] = 0;
+    for (size_t ii = 0; ii < len; ++ii) {
+        uint32_t const a0 = st.dict.alloc_idx;
+        double const t0 = now_us();
+        lzwgc_compress_recv(&st, in[ii]);
+        double const t = now_us() - t0;
+        uint32_t const moved = (st.dict.alloc_idx + n - a0) % n;
+        if (t > r->worst_us) r->worst_us = t;
+        if (moved > r->worst_sweep) r->worst_sweep = moved;
+        for (uint32_t k = 0; k < 3; ++k) r->slow[k] += (t > slow_us[k]) ? 1 : 0;
+    }
+    lzwgc_compress_fini(&st);
+}
+
+// bench runs the corpus as one chunk through compress and decompress,
+// keeping the fastest of `reps` runs of each. Peak memory is taken from
+// the first run.
+static bool bench(corpus const* c, uint32_t bits, uint32_t policy, uint32_t coding, uint32_t reps, result* r) {
+    lzwgc_header hdr;
+    lzwgc_chunk_entry e;
+    double ct = 0, dt = 0;
+
+    lzwgc_header_init(&hdr, bits, (coding_entropy == coding) ? LZWGC_FLAG_ENTROPY : 0);
+    hdr.gc_policy = policy;
+    size_t const cap = lzwgc_chunk_bound(&hdr, c->size);
+    unsigned char * const comp = malloc(cap);
+    unsigned char * const raw = malloc((c->size > 0) ? c->size : 1);
+    bool ok = (0 != comp) && (0 != raw);
+    memset(r, 0, sizeof(result)); // a run that fails early still reports zeros
+
+    for (uint32_t ii = 0; ok && (ii < reps); ++ii) {
+        size_t const cbase = peak_reset();
+        clock_t t0 = clock();
+        lzwgc_chunk_compress(&hdr, c->data, c->size, comp, cap, &e);
+        double const ctime = seconds(t0);
+        if (0 == ii) r->comp_peak_kb = peak_kb(cbase);
+
+        size_t const dbase = peak_reset();
+        t0 = clock();
+        ok = lzwgc_chunk_decompress(&hdr, &e, comp, raw);
+        double const dtime = seconds(t0);
+        if (0 == ii) r->dec_peak_kb = peak_kb(dbase);
+
+        if ((0 == ii) || (ctime < ct)) ct = ctime;
+        if ((0 == ii) || (dtime < dt)) dt = dtime;
+    }
+    free(comp);
+    free(raw);
+
+    if (ok) {
+        r->ratio = (c->size > 0) ? (double)e.comp_len / c->size : 0;
+        r->comp_mbps = mbps(c->size, ct);
+        r->dec_mbps = mbps(c->size, dt);
+        latency(c->data, c->size, bits, policy, r);
+    }
+    return ok;
+}
+
+static void json_string(FILE* out, char const* s) {
+    fputc('"', out);
+    for (; 0 != *s; ++s) {
+        unsigned char const c = (unsigned char)*s;
+        if (('"' == c) || ('\\' == c)) fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+static void report_begin(FILE* out, format_t fmt, uint32_t reps) {
+    if (format_csv == fmt)
+        fprintf(out, "input,bytes,policy,bits,coding,entries,ratio,comp_mbps,dec_mbps,"
+                     "comp_peak_kb,dec_peak_kb,worst_us,worst_sweep,over_10us,over_100us,over_1ms\n");
+    else if (format_json == fmt)
+        fprintf(out, "{\"version\": %u, \"reps\": %u, \"results\": [", LZWGC_VERSION, reps);
+}
+
+static void report_corpus(FILE* out, format_t fmt, corpus const* c) {
+    if (format_text != fmt) return;
+    fprintf(out, "%s: %zu bytes\n", c->name, c->size);
+    fprintf(out, "policy bits  coding     ratio  comp MB/s  dec MB/s  comp KB   dec KB  worst us  worst sweep"
+                 "  >10us  >100us  >1ms\n");
+}
+
+// the sweep means nothing for lru, which never sweeps
+static void report(FILE* out, format_t fmt, bool first, corpus const* c, uint32_t bits, uint32_t policy,
+                   uint32_t coding, bool ok, result const* r) {
+    bool const sweep = (LZWGC_GC_LRU != policy);
+    uint32_t const entries = (1u << bits) - 1 - 256;
+
+    if (format_text == fmt) {
+        if (!ok) {
+            fprintf(out, "%-6s %2u  %-7s  round trip FAILED\n", policy_name[policy], bits, coding_name[coding]);
+            return;
+        }
+        fprintf(out, "%-6s %2u  %-7s  %8.3f  %9.2f  %8.2f  %7zu  %7zu  %8.1f", policy_name[policy], bits,
+                coding_name[coding], r->ratio, r->comp_mbps, r->dec_mbps, r->comp_peak_kb, r->dec_peak_kb, r->worst_us);
+        if (sweep) fprintf(out, "  %11u", r->worst_sweep);
+        else fprintf(out, "            -");
+        fprintf(out, "  %5zu  %6zu  %4zu\n", r->slow[0], r->slow[1], r->slow[2]);
+    } else if (format_csv == fmt) {
+        // names with a comma or quote are quoted, doubling the quotes
+        if (0 != strpbrk(c->name, ",\"\n")) {
+            fputc('"', out);
+            for (char const* s = c->name; 0 != *s; ++s) {
+                if ('"' == *s) fputc('"', out);
+                fputc(*s, out);
+            }
+            fputc('"', out);
+        } else {
+            fputs(c->name, out);
+        }
+        fprintf(out, ",%zu,%s,%u,%s,%u,", c->size, policy_name[policy], bits, coding_name[coding], entries);
+        if (!ok) { fprintf(out, ",,,,,,,,,\n"); return; }
+        fprintf(out, "%.5f,%.3f,%.3f,%zu,%zu,%.1f,", r->ratio, r->comp_mbps, r->dec_mbps,
+                r->comp_peak_kb, r->dec_peak_kb, r->worst_us);
+        if (sweep) fprintf(out, "%u", r->worst_sweep);
+        fprintf(out, ",%zu,%zu,%zu\n", r->slow[0], r->slow[1], r->slow[2]);
+    } else {
+        fprintf(out, "%s\n  {\"input\": ", first ? "" : ",");
+        json_string(out, c->name);
+        fprintf(out, ", \"bytes\": %zu, \"policy\": \"%s\", \"bits\": %u, \"coding\": \"%s\", \"entries\": %u, \"ok\": %s",
+                c->size, policy_name[policy], bits, coding_name[coding], entries, ok ? "true" : "false");
+        if (ok) {
+            fprintf(out, ", \"ratio\": %.5f, \"comp_mbps\": %.3f, \"dec_mbps\": %.3f, "
+                         "\"comp_peak_kb\": %zu, \"dec_peak_kb\": %zu, \"worst_us\": %.1f, \"worst_sweep\": ",
+                    r->ratio, r->comp_mbps, r->dec_mbps, r->comp_peak_kb, r->dec_peak_kb, r->worst_us);
+            if (sweep) fprintf(out, "%u", r->worst_sweep);
+            else fprintf(out, "null");
+            fprintf(out, ", \"over_10us\": %zu, \"over_100us\": %zu, \"over_1ms\": %zu",
+                    r->slow[0], r->slow[1], r->slow[2]);
+        }
+        fputc('}', out);
+    }
+}
+
+static void report_end(FILE* out, format_t fmt) {
+    if (format_json == fmt) fprintf(out, "\n]}\n");
+}
+
+// parse_bits reads "n" or "lo-hi" into the set of widths
+static bool parse_bits(char const* arg, uint32_t* widths) {
+    char* end;
+    unsigned long lo = strtoul(arg, &end, 10), hi = lo;
+    if ('-' == *end) hi = strtoul(end + 1, &end, 10);
+    if ((0 != *end) || (lo < bits_min) || (hi > bits_max) || (lo > hi)) return false;
+    for (unsigned long b = lo; b <= hi; ++b) (*widths) |= (1u << b);
+    return true;
+}
+
+static bool parse_policy(char const* arg, uint32_t* policies) {
+    for (uint32_t p = 0; p < LZWGC_GC_COUNT; ++p) {
+        if ((0 == strcmp(arg, policy_name[p])) || ((arg[0] == (char)('0' + p)) && (0 == arg[1]))) {
+            (*policies) |= (1u << p);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_coding(char const* arg, uint32_t* codings) {
+    for (uint32_t k = 0; k < coding_count; ++k) {
+        if (0 == strcmp(arg, coding_name[k])) {
+            (*codings) |= (1u << k);
+            return true;
+        }
+    }
+    return false;
+}
+
+/** LZW-GC benchmark suite:
+ *  lzwgc_bench [-r reps] [-b bits|lo-hi]... [-p policy]... [-c fixed|entropy]...
+ *              [-s synth_kb] [-f text|csv|json] [-o report] input...
+ *  Each input is a file, or one of the generated corpora :random,
+ *  :repeat and :text (-s KB each, default 4096, fixed seed), and is
+ *  compressed as one chunk under each GC policy (default all) at each
+ *  token width (default 9 to 24, i.e. 2^8 to 2^24 dictionary entries),
+ *  with the tokens written at a fixed width or entropy coded (default
+ *  fixed only).
+ *  Reported per run: compressed/raw ratio, compress and decompress MB/s
+ *  (CPU time, best of reps, default 3), the memory each made resident
+ *  (Linux only, else 0), the worst wall-clock time spent on a single
+ *  input byte, the longest clock sweep and how many bytes took over
+ *  10us, 100us and 1ms. A hashtable rebuild would show as one worst
+ *  case far above the rest once a large dictionary churns, e.g.
+ *  -b 24 -p clock -r 1 -s 196608 :random. csv and json are meant for
+ *  tracking results across builds.
+ */
+int main(int argc, char * argv[]) {
+    uint32_t reps = 3, widths = 0, policies = 0, codings = 0;
+    size_t synth_len = (size_t)default_synth_kb << 10;
+    format_t fmt = format_text;
+    char const * report_path = 0;
+    bool ok = true;
+    int i = 1;
+
+    for (; (i + 1 < argc) && ('-' == argv[i][0]) && (0 != argv[i][1]) && (0 == argv[i][2]); i += 2) {
+        char const * const arg = argv[i + 1];
+        switch (argv[i][1]) {
+        case 'r': reps = atoi(arg); break;
+        case 's': synth_len = (size_t)strtoul(arg, 0, 10) << 10; break;
+        case 'o': report_path = arg; break;
+        case 'b':
+            if (!parse_bits(arg, &widths)) {
+                printf("ERROR: Token width must be %d to %d bits.", bits_min, bits_max);
+                return -1;
+            }
+            break;
+        case 'p':
+            if (!parse_policy(arg, &policies)) {
+                printf("ERROR: Unknown GC policy %s.", arg);
+                return -1;
+            }
+            break;
+        case 'c':
+            if (!parse_coding(arg, &codings)) {
+                printf("ERROR: Unknown coding %s.", arg);
+                return -1;
+            }
+            break;
+        case 'f':
+            if (0 == strcmp(arg, "text")) fmt = format_text;
+            else if (0 == strcmp(arg, "csv")) fmt = format_csv;
+            else if (0 == strcmp(arg, "json")) fmt = format_json;
+            else {
+                printf("ERROR: Unknown format %s.", arg);
+                return -1;
+            }
+            break;
+        default:
+            printf("ERROR: Unknown option %s.", argv[i]);
+            return -1;
+        }
+    }
+    if ((i >= argc) || (0 == reps)) {
+        printf("ERROR: Argument required.");
+        return -1;
+    }
+    if (0 == widths) parse_bits("9-24", &widths);
+    if (0 == policies) policies = (1u << LZWGC_GC_COUNT) - 1;
+    if (0 == codings) codings = (1u << coding_fixed);
+
+    FILE * const out = (0 != report_path) ? lzwgc_fopen(report_path, "w") : stdout;
+    if (0 == out) {
+        printf("ERROR: Cannot open file %s.", report_path);
+        return -1;
+    }
+
+    bool first = true;
+    report_begin(out, fmt, reps);
+    for (; i < argc; ++i) {
+        corpus c;
+        if (!corpus_open(&c, argv[i], synth_len)) {
+            fprintf(stderr, "ERROR: Cannot open file %s.\n", argv[i]);
+            ok = false;
+            continue;
+        }
+        report_corpus(out, fmt, &c);
+        for (uint32_t p = 0; p < LZWGC_GC_COUNT; ++p) {
+            if (0 == (policies & (1u << p))) continue;
+            for (uint32_t b = bits_min; b <= bits_max; ++b) {
+                if (0 == (widths & (1u << b))) continue;
+                for (uint32_t k = 0; k < coding_count; ++k) {
+                    if (0 == (codings & (1u << k))) continue;
+                    result r;
+                    bool const rok = bench(&c, b, p, k, reps, &r);
+                    report(out, fmt, first, &c, b, p, k, rok, &r);
+                    fflush(out);
+                    ok = rok && ok;
+                    first = false;
+                }
+            }
+        }
+        corpus_close(&c);
+    }
+    report_end(out, fmt);
+
+    if (stdout != out) fclose(out);
+    return ok ? 0 : -1;
+}
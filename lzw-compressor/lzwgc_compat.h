@@ -0,0 +1,52 @@
+/*
+* Portability shims for the command line drivers.
+*
+* The drivers were written against the MSVC runtime, whose SDL checks
+* reject plain fopen, while fopen_s is an optional C11 extension that
+* glibc and most other C libraries do not provide.
+*
+* Container offsets are 64 bits, but fseek and ftell take a long, which
+* Windows keeps at 32 bits even in 64 bit builds; past 2GB they would
+* seek to the wrong place. The 64 bit calls are _fseeki64 there and
+* fseeko elsewhere (with a 64 bit off_t, as on any 64 bit POSIX system
+* or where _FILE_OFFSET_BITS is 64).
+*/
+
+#ifndef LZWGC_COMPAT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#ifndef _MSC_VER
+#include <sys/types.h>
+#endif
+
+// lzwgc_fopen opens a file as fopen does; 0 on failure
+static inline FILE* lzwgc_fopen(char const* path, char const* mode) {
+#ifdef _MSC_VER
+    FILE* f;
+    return (0 == fopen_s(&f, path, mode)) ? f : 0;
+#else
+    return fopen(path, mode);
+#endif
+}
+
+// lzwgc_fseek64 seeks as fseek does, to any 64 bit offset; 0 on success
+static inline int lzwgc_fseek64(FILE* f, int64_t offset, int origin) {
+#ifdef _MSC_VER
+    return _fseeki64(f, offset, origin);
+#else
+    return fseeko(f, (off_t)offset, origin);
+#endif
+}
+
+// lzwgc_ftell64 is the position as ftell gives it; -1 on failure
+static inline int64_t lzwgc_ftell64(FILE* f) {
+#ifdef _MSC_VER
+    return _ftelli64(f);
+#else
+    return (int64_t)ftello(f);
+#endif
+}
+
+#define LZWGC_COMPAT_H
+#endif
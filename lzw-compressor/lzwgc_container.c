@@ -0,0 +1,398 @@
+
+
+#include "lzwgc_container.h"
+#include "lzwgc_pack.h"
+#include "lzwgc_entropy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define chunk_block (1 << 16) // tokens staged between compress and pack
+
+// a chunk is sampled in up to sample_windows windows of sample_window
+// bytes, spread evenly over it
+#define sample_windows 16
+#define sample_window  1024
+#define sample_table   4096  // slots for the 4 byte strings seen
+
+static void put16(unsigned char* b, uint32_t v) {
+    b[0] = (unsigned char)v; b[1] = (unsigned char)(v >> 8);
+}
+static void put32(unsigned char* b, uint32_t v) {
+    put16(b, v); put16(b + 2, v >> 16);
+}
+static void put64(unsigned char* b, uint64_t v) {
+    put32(b, (uint32_t)v); put32(b + 4, (uint32_t)(v >> 32));
+}
+static uint32_t get16(unsigned char const* b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8);
+}
+static uint32_t get32(unsigned char const* b) {
+    return get16(b) | (get16(b + 2) << 16);
+}
+static uint64_t get64(unsigned char const* b) {
+    return (uint64_t)get32(b) | ((uint64_t)get32(b + 4) << 32);
+}
+
+void lzwgc_header_init(lzwgc_header* h, uint32_t bits, uint32_t flags) {
+    h->version = LZWGC_VERSION;
+    h->bits = bits;
+    h->gc_policy = LZWGC_GC_CLOCK;
+    h->flags = flags;
+    h->dict_id = 0;
+}
+
+void lzwgc_header_encode(lzwgc_header const* h, unsigned char* b) {
+    memcpy(b, "LZWG", 4);
+    put16(b + 4, h->version);
+    b[6] = (unsigned char)h->bits;
+    b[7] = (unsigned char)h->gc_policy;
+    put32(b + 8, h->flags);
+    put32(b + 12, h->dict_id);
+}
+
+bool lzwgc_header_decode(lzwgc_header* h, unsigned char const* b) {
+    if (0 != memcmp(b, "LZWG", 4)) return false;
+    h->version = get16(b + 4);
+    h->bits = b[6];
+    h->gc_policy = b[7];
+    h->flags = get32(b + 8);
+    h->dict_id = (h->version >= 2) ? get32(b + 12) : 0;
+    uint32_t const known = (h->version >= 3) ? LZWGC_FLAG_ALL : LZWGC_FLAG_GROW;
+    bool const grow = (0 != (h->flags & LZWGC_FLAG_GROW));
+    return (1 <= h->version) && (h->version <= LZWGC_VERSION) &&
+        (9 <= h->bits) && (h->bits <= 24) &&
+        (h->gc_policy < LZWGC_GC_COUNT) && (0 == (h->flags & ~known)) &&
+        (!grow || ((0 == h->dict_id) && (0 == (h->flags & LZWGC_FLAG_ENTROPY))));
+}
+
+size_t lzwgc_index_size(uint32_t count) {
+    return ((size_t)count * LZWGC_ENTRY_SIZE) + LZWGC_TRAILER_SIZE;
+}
+
+void lzwgc_entry_encode(lzwgc_chunk_entry const* e, unsigned char* b) {
+    put64(b, e->offset);
+    put64(b + 8, e->comp_len);
+    put64(b + 16, e->raw_len);
+    put32(b + 24, e->checksum);
+    put32(b + 28, e->type);
+}
+
+void lzwgc_entry_decode(lzwgc_chunk_entry* e, unsigned char const* b) {
+    e->offset = get64(b);
+    e->comp_len = get64(b + 8);
+    e->raw_len = get64(b + 16);
+    e->checksum = get32(b + 24);
+    e->type = get32(b + 28);
+}
+
+void lzwgc_index_encode(lzwgc_chunk_entry const* e, uint32_t count, uint64_t index_offset, unsigned char* b) {
+    for (uint32_t ii = 0; ii < count; ++ii) {
+        lzwgc_entry_encode(e + ii, b);
+        b += LZWGC_ENTRY_SIZE;
+    }
+    put64(b, index_offset);
+    put32(b + 8, count);
+    memcpy(b + 12, "LZWI", 4);
+}
+
+bool lzwgc_trailer_decode(lzwgc_trailer* t, unsigned char const* b) {
+    if (0 != memcmp(b + 12, "LZWI", 4)) return false;
+    t->index_offset = get64(b);
+    t->chunk_count = get32(b + 8);
+    return true;
+}
+
+bool lzwgc_container_parse(unsigned char const* buf, size_t len, lzwgc_header* h, lzwgc_trailer* t) {
+    if (len < (LZWGC_HEADER_SIZE + LZWGC_TRAILER_SIZE)) return false;
+    if (!lzwgc_header_decode(h, buf)) return false;
+    if (!lzwgc_trailer_decode(t, buf + len - LZWGC_TRAILER_SIZE)) return false;
+
+    uint64_t const index_end = len - LZWGC_TRAILER_SIZE;
+    if ((t->index_offset < LZWGC_HEADER_SIZE) || (t->index_offset > index_end)) return false;
+    if (((index_end - t->index_offset) / LZWGC_ENTRY_SIZE) < t->chunk_count) return false;
+
+    for (uint32_t ii = 0; ii < t->chunk_count; ++ii) {
+        lzwgc_chunk_entry e;
+        lzwgc_entry_decode(&e, buf + t->index_offset + ((size_t)ii * LZWGC_ENTRY_SIZE));
+        if ((e.offset < LZWGC_HEADER_SIZE) || (e.offset > t->index_offset) ||
+            (e.comp_len > (t->index_offset - e.offset)) || (e.type > LZWGC_CHUNK_STORED) ||
+            ((LZWGC_CHUNK_STORED == e.type) && (e.comp_len != e.raw_len)))
+            return false;
+    }
+    return true;
+}
+
+uint64_t lzwgc_container_raw_size(unsigned char const* buf, lzwgc_trailer const* t) {
+    uint64_t size = 0;
+    for (uint32_t ii = 0; ii < t->chunk_count; ++ii) {
+        lzwgc_chunk_entry e;
+        lzwgc_entry_decode(&e, buf + t->index_offset + ((size_t)ii * LZWGC_ENTRY_SIZE));
+        size += e.raw_len;
+    }
+    return size;
+}
+
+uint32_t lzwgc_adler32(uint32_t adler, unsigned char const* p, size_t len) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (len > 0) {
+        // 5552 is the most bytes we can sum before b could overflow
+        size_t n = (len < 5552) ? len : 5552;
+        len -= n;
+        while (n--) { a += *p++; b += a; }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+size_t lzwgc_chunk_bound(lzwgc_header const* h, size_t len) {
+    if (0 != (h->flags & LZWGC_FLAG_ENTROPY))
+        return lzwgc_epack_bound(len + 1, h->bits);
+    return lzwgc_pack_bound(len + 1, h->bits);
+}
+
+size_t lzwgc_chunk_compress(lzwgc_header const* h, unsigned char const* in, size_t len,
+                            unsigned char* out, size_t cap, lzwgc_chunk_entry* e) {
+    return lzwgc_chunk_compress_dict(h, 0, in, len, out, cap, e);
+}
+
+// a preset must describe the same dictionary as the header
+static bool preset_matches(lzwgc_header const* h, lzwgc_dict const* preset) {
+    if (0 == h->dict_id) return (0 == preset);
+    return (0 != preset) && (preset->size == (uint32_t)((1 << h->bits) - 1)) &&
+        (preset->gc_policy == h->gc_policy) && (0 == (h->flags & LZWGC_FLAG_GROW));
+}
+
+void lzwgc_chunk_state_init(lzwgc_chunk_state* cs) {
+    cs->have_comp = false;
+    cs->have_decomp = false;
+    cs->tok_buff = malloc(chunk_block * sizeof(token_t));
+    assert(0 != cs->tok_buff);
+}
+
+void lzwgc_chunk_state_fini(lzwgc_chunk_state* cs) {
+    if (cs->have_comp) lzwgc_compress_fini(&(cs->comp));
+    if (cs->have_decomp) lzwgc_decompress_fini(&(cs->decomp));
+    cs->have_comp = false;
+    cs->have_decomp = false;
+    free(cs->tok_buff);
+    cs->tok_buff = 0;
+}
+
+static bool dict_fits(lzwgc_header const* h, lzwgc_dict const* dict) {
+    return (dict->size == (uint32_t)((1 << h->bits) - 1)) && (dict->gc_policy == h->gc_policy);
+}
+
+// a compressor for the chunk, reset if the state has a fitting one
+static lzwgc_compress* state_compress(lzwgc_chunk_state* cs, lzwgc_header const* h, lzwgc_dict const* preset) {
+    lzwgc_compress * const st = &(cs->comp);
+    if (cs->have_comp && dict_fits(h, &(st->dict))) {
+        lzwgc_compress_reset(st, preset);
+        return st;
+    }
+    if (cs->have_comp) lzwgc_compress_fini(st);
+    if (0 != preset)
+        lzwgc_compress_init_dict(st, preset);
+    else
+        lzwgc_compress_init_gc(st, (1 << h->bits) - 1, h->gc_policy);
+    cs->have_comp = true;
+    return st;
+}
+
+static lzwgc_decompress* state_decompress(lzwgc_chunk_state* cs, lzwgc_header const* h, lzwgc_dict const* preset) {
+    lzwgc_decompress * const st = &(cs->decomp);
+    if (cs->have_decomp && dict_fits(h, &(st->dict))) {
+        lzwgc_decompress_reset(st, preset);
+        return st;
+    }
+    if (cs->have_decomp) lzwgc_decompress_fini(st);
+    if (0 != preset)
+        lzwgc_decompress_init_dict(st, preset);
+    else
+        lzwgc_decompress_init_gc(st, (1 << h->bits) - 1, h->gc_policy);
+    cs->have_decomp = true;
+    return st;
+}
+
+// incompressible data has nearly flat byte frequencies, and no strings
+// recur. lzw expands flat data well before it reaches 8 bits of entropy
+// per byte, so we only ask for collision entropy of 7.4 bits or more
+// (sum of squared frequencies within 1.5 times that of uniform bytes).
+// recurring 4 byte strings, under 1 in 32, catch high entropy data that
+// repeats, which lzw does compress. chunks too short to sample are left
+// to the trial; coding them costs little.
+bool lzwgc_looks_incompressible(unsigned char const* in, size_t len) {
+    uint32_t const windows = (len / sample_window < sample_windows) ?
+        (uint32_t)(len / sample_window) : sample_windows;
+    if (windows < 2)
+        return false;
+
+    uint32_t counts[256];
+    uint64_t seen[sample_table];
+    uint64_t repeats = 0;
+    memset(counts, 0, sizeof(counts));
+    memset(seen, 0, sizeof(seen));
+    for (uint32_t w = 0; w < windows; ++w) {
+        unsigned char const * const p = in + (((len - sample_window) / (windows - 1)) * w);
+        for (uint32_t ii = 0; ii < sample_window; ++ii)
+            counts[p[ii]] += 1;
+        for (uint32_t ii = 0; ii + 4 <= sample_window; ++ii) {
+            uint32_t const v = (uint32_t)p[ii] | ((uint32_t)p[ii + 1] << 8) |
+                ((uint32_t)p[ii + 2] << 16) | ((uint32_t)p[ii + 3] << 24);
+            uint64_t const key = (1ull << 32) | v; // never 0, an empty slot
+            uint64_t * const slot = seen + ((v * 2654435761u) >> 20);
+            if ((*slot) == key) repeats += 1;
+            else (*slot) = key;
+        }
+    }
+
+    uint64_t const n = (uint64_t)windows * sample_window;
+    uint64_t sum_sq = 0;
+    for (uint32_t c = 0; c < 256; ++c)
+        sum_sq += (uint64_t)counts[c] * counts[c];
+    return ((256 * sum_sq) <= (n * n + (n * n) / 2)) && ((repeats * 32) < n);
+}
+
+// the chunk as it is
+static size_t chunk_store(unsigned char const* in, size_t len, unsigned char* out, lzwgc_chunk_entry* e) {
+    memcpy(out, in, len);
+    e->comp_len = len;
+    e->type = LZWGC_CHUNK_STORED;
+    return len;
+}
+
+size_t lzwgc_chunk_compress_dict(lzwgc_header const* h, lzwgc_dict const* preset,
+                                 unsigned char const* in, size_t len,
+                                 unsigned char* out, size_t cap, lzwgc_chunk_entry* e) {
+    lzwgc_chunk_state cs;
+    lzwgc_chunk_state_init(&cs);
+    size_t const size = lzwgc_chunk_compress_state(h, preset, &cs, in, len, out, cap, e);
+    lzwgc_chunk_state_fini(&cs);
+    return size;
+}
+
+size_t lzwgc_chunk_compress_state(lzwgc_header const* h, lzwgc_dict const* preset, lzwgc_chunk_state* cs,
+                                  unsigned char const* in, size_t len,
+                                  unsigned char* out, size_t cap, lzwgc_chunk_entry* e) {
+    assert(preset_matches(h, preset));
+    e->offset = 0;
+    e->comp_len = 0;
+    e->raw_len = 0;
+    e->checksum = 0;
+    e->type = LZWGC_CHUNK_TOKENS;
+    if (cap < lzwgc_chunk_bound(h, len))
+        return 0;
+
+    e->raw_len = len;
+    e->checksum = lzwgc_adler32(1, in, len);
+    if (lzwgc_looks_incompressible(in, len))
+        return chunk_store(in, len, out, e);
+
+    lzwgc_pack pk;
+    lzwgc_epack ep;
+    bool const entropy = (0 != (h->flags & LZWGC_FLAG_ENTROPY));
+    token_t * const tok_buff = cs->tok_buff;
+    lzwgc_compress * const st = state_compress(cs, h, preset);
+    st->ranked = entropy;
+    if (entropy)
+        lzwgc_epack_init(&ep, h->bits, out, cap);
+    else
+        lzwgc_pack_init(&pk, h->bits, (0 != (h->flags & LZWGC_FLAG_GROW)), out, cap);
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t used;
+        size_t const ntok = lzwgc_compress_block(st, in + pos, len - pos, tok_buff, chunk_block, &used);
+        if (entropy) lzwgc_epack_tokens(&ep, tok_buff, ntok);
+        else lzwgc_pack_tokens(&pk, tok_buff, ntok);
+        pos += used;
+    }
+    lzwgc_compress_flush(st); // the final token; the state is kept for the next chunk
+    if (st->have_output) {
+        if (entropy) lzwgc_epack_tokens(&ep, &(st->token_output), 1);
+        else lzwgc_pack_tokens(&pk, &(st->token_output), 1);
+    }
+    size_t size;
+    if (entropy) {
+        lzwgc_epack_flush(&ep);
+        lzwgc_epack_fini(&ep);
+        size = ep.size;
+    } else {
+        lzwgc_pack_flush(&pk);
+        size = pk.size;
+    }
+
+    if (size >= len)
+        return chunk_store(in, len, out, e);
+    e->comp_len = size;
+    return size;
+}
+
+bool lzwgc_chunk_decompress(lzwgc_header const* h, lzwgc_chunk_entry const* e,
+                            unsigned char const* in, unsigned char* out) {
+    return lzwgc_chunk_decompress_dict(h, 0, e, in, out);
+}
+
+bool lzwgc_chunk_decompress_dict(lzwgc_header const* h, lzwgc_dict const* preset,
+                                 lzwgc_chunk_entry const* e, unsigned char const* in, unsigned char* out) {
+    lzwgc_chunk_state cs;
+    lzwgc_chunk_state_init(&cs);
+    bool const ok = lzwgc_chunk_decompress_state(h, preset, &cs, e, in, out);
+    lzwgc_chunk_state_fini(&cs);
+    return ok;
+}
+
+bool lzwgc_chunk_decompress_state(lzwgc_header const* h, lzwgc_dict const* preset, lzwgc_chunk_state* cs,
+                                  lzwgc_chunk_entry const* e, unsigned char const* in, unsigned char* out) {
+    if (!preset_matches(h, preset))
+        return false; // e.g. the stream needs a preset we were not given
+    if (LZWGC_CHUNK_STORED == e->type) {
+        if (e->comp_len != e->raw_len) return false;
+        memcpy(out, in, (size_t)e->raw_len);
+        return (lzwgc_adler32(1, out, (size_t)e->raw_len) == e->checksum);
+    }
+    if (LZWGC_CHUNK_TOKENS != e->type)
+        return false;
+
+    lzwgc_unpack up;
+    lzwgc_eunpack eu;
+    bool const entropy = (0 != (h->flags & LZWGC_FLAG_ENTROPY));
+    token_t * const tok_buff = cs->tok_buff;
+    lzwgc_decompress * const st = state_decompress(cs, h, preset);
+    st->ranked = entropy;
+    if (entropy) {
+        lzwgc_eunpack_init(&eu, h->bits);
+        lzwgc_eunpack_feed(&eu, in, (size_t)e->comp_len);
+    } else {
+        lzwgc_unpack_init(&up, h->bits, (0 != (h->flags & LZWGC_FLAG_GROW)));
+        lzwgc_unpack_feed(&up, in, (size_t)e->comp_len);
+    }
+
+    // copying strings from the output only pays when the dictionary
+    // update does not walk the chain anyway, which clock GC does
+    bool const hist = (LZWGC_GC_CLOCK != h->gc_policy);
+    size_t const raw_len = (size_t)e->raw_len;
+    size_t ct = 0;
+    bool valid = true;
+    size_t ntok;
+    while (valid && (0 != (ntok = entropy ? lzwgc_eunpack_tokens(&eu, tok_buff, chunk_block)
+                                          : lzwgc_unpack_tokens(&up, tok_buff, chunk_block)))) {
+        size_t pos = 0;
+        while (pos < ntok) {
+            size_t used;
+            ct += hist ? lzwgc_decompress_hist(st, tok_buff + pos, ntok - pos, out, ct, raw_len, &used)
+                       : lzwgc_decompress_block(st, tok_buff + pos, ntok - pos, out + ct, raw_len - ct, &used);
+            if (0 == used) { valid = false; break; } // invalid token or too long
+            pos += used;
+        }
+    }
+    if (entropy) {
+        valid = valid && !eu.corrupt;
+        lzwgc_eunpack_fini(&eu);
+    }
+
+    return valid && (ct == raw_len) &&
+        (lzwgc_adler32(1, out, raw_len) == e->checksum);
+}
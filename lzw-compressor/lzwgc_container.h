@@ -0,0 +1,135 @@
+/*
+* Container format for LZW-GC compressed files.
+*
+* A file is a fixed header, the compressed chunks, then a chunk index:
+*
+*   header   magic "LZWG", version, token width, GC policy, flags,
+*            preset dictionary id (version 2, 0 for none)
+*   chunks   independently packed token streams, one dictionary each;
+*            with LZWGC_FLAG_ENTROPY, allocation ranks entropy coded
+*            by lzwgc_epack instead (version 3). A chunk that would not
+*            shrink is stored as its raw bytes instead (version 4)
+*   index    one entry per chunk (offset, sizes, checksum, type)
+*   trailer  offset of the index, chunk count, magic "LZWI"
+*
+* The index sits at the end so that writers can stream chunks out in
+* order and only describe them once all are known. Readers load the
+* header and trailer, after which any chunk entry is a single read at
+* index_offset + (i * LZWGC_ENTRY_SIZE). All fields are little endian.
+*
+* Checksums are Adler-32 of the uncompressed chunk.
+*/
+
+#ifndef LZWGC_CONTAINER_H
+
+#include "lzwgc.h"
+
+#define LZWGC_VERSION       4 // 3 lacks stored chunks, 2 entropy coding, 1 the preset id; all still read
+#define LZWGC_HEADER_SIZE   16
+#define LZWGC_ENTRY_SIZE    32
+#define LZWGC_TRAILER_SIZE  16
+
+#define LZWGC_FLAG_GROW     0x1 // token width grows with the dictionary (not with a preset)
+#define LZWGC_FLAG_ENTROPY  0x2 // chunks are entropy coded (not with GROW)
+#define LZWGC_FLAG_ALL      0x3
+
+// chunk types; earlier versions left the field 0
+#define LZWGC_CHUNK_TOKENS  0 // coded as the header says
+#define LZWGC_CHUNK_STORED  1 // the raw bytes; comp_len equals raw_len
+
+typedef struct
+{
+    uint32_t        version;     // LZWGC_VERSION
+    uint32_t        bits;        // token width; dictionary is 2^bits - 1
+    uint32_t        gc_policy;   // LZWGC_GC_*, clock unless set after init
+    uint32_t        flags;       // LZWGC_FLAG_*
+    uint32_t        dict_id;     // lzwgc_preset_id, or 0 for an empty dictionary
+} lzwgc_header;
+
+typedef struct
+{
+    uint64_t        offset;      // file offset of compressed data
+    uint64_t        comp_len;    // compressed bytes
+    uint64_t        raw_len;     // uncompressed bytes
+    uint32_t        checksum;    // adler-32 of uncompressed bytes
+    uint32_t        type;        // LZWGC_CHUNK_*
+} lzwgc_chunk_entry;
+
+typedef struct
+{
+    uint64_t        index_offset; // file offset of the first entry
+    uint32_t        chunk_count;
+} lzwgc_trailer;
+
+void lzwgc_header_init(lzwgc_header*, uint32_t bits, uint32_t flags);
+void lzwgc_header_encode(lzwgc_header const*, unsigned char* buf);
+bool lzwgc_header_decode(lzwgc_header*, unsigned char const* buf); // false if not ours
+
+// index holds count entries followed by the trailer
+size_t lzwgc_index_size(uint32_t count);
+void lzwgc_index_encode(lzwgc_chunk_entry const*, uint32_t count, uint64_t index_offset, unsigned char* buf);
+void lzwgc_entry_encode(lzwgc_chunk_entry const*, unsigned char* buf);
+void lzwgc_entry_decode(lzwgc_chunk_entry*, unsigned char const* buf);
+bool lzwgc_trailer_decode(lzwgc_trailer*, unsigned char const* buf); // false if not ours
+
+// parse checks an in-memory container: header, trailer, and that every
+// chunk lies between the header and the index. False if malformed.
+bool lzwgc_container_parse(unsigned char const* buf, size_t len, lzwgc_header*, lzwgc_trailer*);
+uint64_t lzwgc_container_raw_size(unsigned char const* buf, lzwgc_trailer const*);
+
+uint32_t lzwgc_adler32(uint32_t adler, unsigned char const*, size_t len); // start with 1
+
+// Chunk API; a whole chunk at a time
+// compress writes the packed chunk to `out` and fills in the entry
+// (everything but offset). Returns compressed size, or 0 with an empty
+// entry if `cap` is below lzwgc_chunk_bound. A chunk is stored instead,
+// so it never grows, if coding it did not shrink it or if a sample of
+// it looks incompressible (e.g. already compressed), which skips the
+// dictionary altogether. lzwgc_chunk_bound still covers the coding.
+size_t lzwgc_chunk_bound(lzwgc_header const*, size_t len);
+size_t lzwgc_chunk_compress(lzwgc_header const*, unsigned char const* in, size_t len,
+                            unsigned char* out, size_t cap, lzwgc_chunk_entry*);
+
+// looks_incompressible is that sample: up to 16 windows of 1KB spread
+// over `in`, false if there are fewer than 2. The streaming writers,
+// which cannot try a chunk first, ask it of every 64KB block.
+bool lzwgc_looks_incompressible(unsigned char const* in, size_t len);
+
+// decompress expands entry->comp_len bytes from `in` into exactly
+// entry->raw_len bytes at `out`. False if the chunk is corrupt.
+bool lzwgc_chunk_decompress(lzwgc_header const*, lzwgc_chunk_entry const*,
+                            unsigned char const* in, unsigned char* out);
+
+// as above, starting every chunk from a copy of `preset`, which must
+// match h->dict_id, bits and gc_policy (0 when h->dict_id is 0)
+size_t lzwgc_chunk_compress_dict(lzwgc_header const*, lzwgc_dict const* preset,
+                                 unsigned char const* in, size_t len,
+                                 unsigned char* out, size_t cap, lzwgc_chunk_entry*);
+bool lzwgc_chunk_decompress_dict(lzwgc_header const*, lzwgc_dict const* preset,
+                                 lzwgc_chunk_entry const*, unsigned char const* in, unsigned char* out);
+
+// Chunk state; whoever handles many chunks (e.g. one per worker) keeps
+// one, so each chunk after the first costs a dictionary reset instead
+// of an allocation and a full initialization. It takes its width and
+// policy from the first chunk, and starts over for one that differs.
+typedef struct
+{
+    lzwgc_compress      comp;
+    lzwgc_decompress    decomp;
+    bool                have_comp;
+    bool                have_decomp;
+    token_t           * tok_buff;
+} lzwgc_chunk_state;
+
+void lzwgc_chunk_state_init(lzwgc_chunk_state*);
+void lzwgc_chunk_state_fini(lzwgc_chunk_state*);
+
+// as lzwgc_chunk_compress_dict and lzwgc_chunk_decompress_dict
+size_t lzwgc_chunk_compress_state(lzwgc_header const*, lzwgc_dict const* preset, lzwgc_chunk_state*,
+                                  unsigned char const* in, size_t len,
+                                  unsigned char* out, size_t cap, lzwgc_chunk_entry*);
+bool lzwgc_chunk_decompress_state(lzwgc_header const*, lzwgc_dict const* preset, lzwgc_chunk_state*,
+                                  lzwgc_chunk_entry const*, unsigned char const* in, unsigned char* out);
+
+#define LZWGC_CONTAINER_H
+#endif
@@ -0,0 +1,414 @@
+
+
+#include "lzwgc_entropy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define frame_header 8
+#define prob_bits 11              // probabilities out of 2048
+#define prob_init (1 << (prob_bits - 1))
+#define move_bits 5               // adaptation rate
+#define range_top (1u << 24)      // renormalize below this
+
+static void put32(unsigned char* b, uint32_t v) {
+    b[0] = (unsigned char)v; b[1] = (unsigned char)(v >> 8);
+    b[2] = (unsigned char)(v >> 16); b[3] = (unsigned char)(v >> 24);
+}
+static uint32_t get32(unsigned char const* b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) |
+        ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static void probs_init(uint16_t* p, size_t n) {
+    for (size_t ii = 0; ii < n; ++ii) p[ii] = prob_init;
+}
+
+static void model_init(lzwgc_emodel* m) {
+    probs_init(m->is_lit, 2);
+    probs_init(m->lit, 256);
+    probs_init(m->len, 32);
+    for (uint32_t ii = 0; ii < 25; ++ii)
+        probs_init(m->mid[ii], 1 << LZWGC_EPACK_MID);
+    m->prev_lit = true;
+}
+
+// bit length of x; 0 for 0
+static uint32_t bit_length(uint32_t x) {
+    uint32_t n = 0;
+    while (x > 0) { ++n; x >>= 1; }
+    return n;
+}
+
+// payload of a stored frame
+static size_t stored_size(size_t count, uint32_t bits) {
+    return ((count * bits) + 7) / 8;
+}
+
+size_t lzwgc_epack_bound(size_t count, uint32_t bits) {
+    size_t const frames = (count / LZWGC_EPACK_FRAME) + 1;
+    return lzwgc_pack_bound(count, bits) + (frames * (frame_header + 8));
+}
+
+// range encoder, as in LZMA: the carry out of `low` propagates into the
+// one byte held back in `cache` and any 0xff bytes after it. Bytes past
+// `limit` are counted but not written; the frame is stored instead.
+typedef struct
+{
+    uint64_t        low;
+    uint32_t        range;
+    unsigned char   cache;
+    size_t          cache_size;
+    unsigned char * out;
+    size_t          len;
+    size_t          limit;
+} rc_enc;
+
+static void rc_shift_low(rc_enc* rc) {
+    if (((uint32_t)rc->low < 0xff000000u) || (0 != (rc->low >> 32))) {
+        unsigned char const carry = (unsigned char)(rc->low >> 32);
+        unsigned char b = rc->cache;
+        do {
+            if (rc->len < rc->limit) rc->out[rc->len] = (unsigned char)(b + carry);
+            rc->len += 1;
+            b = 0xff;
+        } while (0 != --(rc->cache_size));
+        rc->cache = (unsigned char)(rc->low >> 24);
+    }
+    rc->cache_size += 1;
+    rc->low = (rc->low & 0x00ffffffu) << 8;
+}
+
+static void rc_bit(rc_enc* rc, uint16_t* p, uint32_t bit) {
+    uint32_t const bound = (rc->range >> prob_bits) * (*p);
+    if (0 == bit) {
+        rc->range = bound;
+        (*p) += ((1 << prob_bits) - (*p)) >> move_bits;
+    } else {
+        rc->low += bound;
+        rc->range -= bound;
+        (*p) -= (*p) >> move_bits;
+    }
+    while (rc->range < range_top) {
+        rc->range <<= 8;
+        rc_shift_low(rc);
+    }
+}
+
+static void rc_direct(rc_enc* rc, uint32_t v, uint32_t nbits) {
+    while (nbits-- > 0) {
+        rc->range >>= 1;
+        if (1 & (v >> nbits)) rc->low += rc->range;
+        while (rc->range < range_top) {
+            rc->range <<= 8;
+            rc_shift_low(rc);
+        }
+    }
+}
+
+static void rc_tree(rc_enc* rc, uint16_t* p, uint32_t v, uint32_t nbits) {
+    uint32_t m = 1;
+    while (nbits-- > 0) {
+        uint32_t const bit = 1 & (v >> nbits);
+        rc_bit(rc, p + m, bit);
+        m = (m << 1) | bit;
+    }
+}
+
+static void encode_token(rc_enc* rc, lzwgc_emodel* m, token_t t) {
+    bool const lit = (t < 256);
+    rc_bit(rc, m->is_lit + m->prev_lit, lit ? 0 : 1);
+    m->prev_lit = lit;
+    if (lit) {
+        rc_tree(rc, m->lit, t, 8);
+        return;
+    }
+    uint32_t const x = t - 256;
+    uint32_t const len = bit_length(x);
+    rc_tree(rc, m->len, len, 5);
+    if (len >= 2) {
+        uint32_t const below = len - 1;
+        uint32_t const k = (below < LZWGC_EPACK_MID) ? below : LZWGC_EPACK_MID;
+        rc_tree(rc, m->mid[len], (x >> (below - k)) & ((1u << k) - 1), k);
+        rc_direct(rc, x, below - k);
+    }
+}
+
+void lzwgc_epack_init(lzwgc_epack* e, uint32_t bits, unsigned char* buf, size_t cap) {
+    assert((9 <= bits) && (bits <= 24));
+    model_init(&(e->model));
+    e->bits = bits;
+    e->frame = malloc(LZWGC_EPACK_FRAME * sizeof(token_t));
+    assert(0 != e->frame);
+    e->pending = 0;
+    e->data = buf;
+    e->size = 0;
+    e->cap = cap;
+}
+
+// write_frame codes the pending tokens, or stores them if that is no
+// smaller, and the models forget them.
+static bool write_frame(lzwgc_epack* e) {
+    size_t const n = e->pending;
+    if (0 == n) return true;
+    if ((e->cap - e->size) < (frame_header + lzwgc_pack_bound(n, e->bits)))
+        return false;
+
+    unsigned char * const head = e->data + e->size;
+    lzwgc_emodel const saved = e->model;
+    rc_enc rc;
+    rc.low = 0;
+    rc.range = 0xffffffffu;
+    rc.cache = 0;
+    rc.cache_size = 1;
+    rc.out = head + frame_header;
+    rc.len = 0;
+    rc.limit = stored_size(n, e->bits);
+
+    for (size_t ii = 0; (ii < n) && (rc.len < rc.limit); ++ii)
+        encode_token(&rc, &(e->model), e->frame[ii]);
+    for (int ii = 0; ii < 5; ++ii)
+        rc_shift_low(&rc);
+
+    size_t len = rc.len;
+    bool const stored = (len >= rc.limit);
+    if (stored) {
+        lzwgc_pack pk;
+        e->model = saved;
+        lzwgc_pack_init(&pk, e->bits, false, head + frame_header, lzwgc_pack_bound(n, e->bits));
+        lzwgc_pack_tokens(&pk, e->frame, n);
+        lzwgc_pack_flush(&pk);
+        len = pk.size;
+    }
+    put32(head, (uint32_t)len | (stored ? 0x80000000u : 0));
+    put32(head + 4, (uint32_t)n);
+    e->size += frame_header + len;
+    e->pending = 0;
+    return true;
+}
+
+size_t lzwgc_epack_tokens(lzwgc_epack* e, token_t const* tok, size_t count) {
+    size_t ii = 0;
+    while (ii < count) {
+        if (LZWGC_EPACK_FRAME == e->pending) {
+            if (!write_frame(e)) break;
+        }
+        size_t n = LZWGC_EPACK_FRAME - e->pending;
+        if (n > (count - ii)) n = count - ii;
+        memcpy(e->frame + e->pending, tok + ii, n * sizeof(token_t));
+        e->pending += n;
+        ii += n;
+    }
+    if (LZWGC_EPACK_FRAME == e->pending)
+        write_frame(e); // so a full frame leaves as soon as it can
+    return ii;
+}
+
+bool lzwgc_epack_flush(lzwgc_epack* e) {
+    return write_frame(e);
+}
+
+void lzwgc_epack_fini(lzwgc_epack* e) {
+    free(e->frame);
+    e->frame = 0;
+}
+
+
+void lzwgc_eunpack_init(lzwgc_eunpack* u, uint32_t bits) {
+    assert((9 <= bits) && (bits <= 24));
+    model_init(&(u->model));
+    u->bits = bits;
+    u->corrupt = false;
+    u->left = 0;
+    u->stored = false;
+    u->in = 0;
+    u->in_end = 0;
+    u->data = 0;
+    u->size = 0;
+    u->pos = 0;
+    u->carry = 0;
+    u->carry_len = 0;
+    u->carry_cap = 0;
+}
+
+void lzwgc_eunpack_feed(lzwgc_eunpack* u, unsigned char const* buf, size_t size) {
+    assert(u->pos == u->size);
+    u->data = buf;
+    u->size = size;
+    u->pos = 0;
+}
+
+// a coded frame holds exactly the bytes the decoder will read
+static unsigned char rc_byte(lzwgc_eunpack* u) {
+    if (u->in < u->in_end) return *(u->in++);
+    u->corrupt = true;
+    return 0;
+}
+
+static uint32_t rd_bit(lzwgc_eunpack* u, uint16_t* p) {
+    uint32_t const bound = (u->range >> prob_bits) * (*p);
+    uint32_t bit;
+    if (u->code < bound) {
+        u->range = bound;
+        (*p) += ((1 << prob_bits) - (*p)) >> move_bits;
+        bit = 0;
+    } else {
+        u->code -= bound;
+        u->range -= bound;
+        (*p) -= (*p) >> move_bits;
+        bit = 1;
+    }
+    if (u->range < range_top) {
+        u->range <<= 8;
+        u->code = (u->code << 8) | rc_byte(u);
+    }
+    return bit;
+}
+
+static uint32_t rd_direct(lzwgc_eunpack* u, uint32_t nbits) {
+    uint32_t v = 0;
+    while (nbits-- > 0) {
+        u->range >>= 1;
+        uint32_t const bit = (u->code >= u->range) ? 1 : 0;
+        u->code -= u->range & (0 - bit);
+        v = (v << 1) | bit;
+        if (u->range < range_top) {
+            u->range <<= 8;
+            u->code = (u->code << 8) | rc_byte(u);
+        }
+    }
+    return v;
+}
+
+static uint32_t rd_tree(lzwgc_eunpack* u, uint16_t* p, uint32_t nbits) {
+    uint32_t m = 1;
+    for (uint32_t ii = 0; ii < nbits; ++ii)
+        m = (m << 1) | rd_bit(u, p + m);
+    return m - (1u << nbits);
+}
+
+static token_t decode_token(lzwgc_eunpack* u) {
+    lzwgc_emodel * const m = &(u->model);
+    bool const lit = (0 == rd_bit(u, m->is_lit + m->prev_lit));
+    m->prev_lit = lit;
+    if (lit)
+        return rd_tree(u, m->lit, 8);
+
+    uint32_t const len = rd_tree(u, m->len, 5);
+    if (len < 2)
+        return 256 + len;
+    if (len > u->bits) {
+        u->corrupt = true; // no such rank
+        return 0;
+    }
+    uint32_t const below = len - 1;
+    uint32_t const k = (below < LZWGC_EPACK_MID) ? below : LZWGC_EPACK_MID;
+    uint32_t x = (1u << k) | rd_tree(u, m->mid[len], k);
+    x = (x << (below - k)) | rd_direct(u, below - k);
+    return 256 + x;
+}
+
+// start_frame begins decoding the frame at `p`, whose header has been
+// checked and whose payload is all there.
+static void start_frame(lzwgc_eunpack* u, unsigned char const* p) {
+    uint32_t const head = get32(p);
+    size_t const len = head & 0x7fffffff;
+    u->left = get32(p + 4);
+    u->stored = (0 != (head & 0x80000000u));
+    p += frame_header;
+    if (u->stored) {
+        lzwgc_unpack_init(&(u->up), u->bits, false);
+        lzwgc_unpack_feed(&(u->up), p, len);
+    } else {
+        u->in = p;
+        u->in_end = p + len;
+        u->range = 0xffffffffu;
+        u->code = 0;
+        for (int ii = 0; ii < 5; ++ii)
+            u->code = (u->code << 8) | rc_byte(u);
+    }
+}
+
+// frame_size is the whole size of the frame with this header, or 0 if
+// the header cannot be right
+static size_t frame_size(lzwgc_eunpack const* u, unsigned char const* p) {
+    uint32_t const head = get32(p);
+    size_t const len = head & 0x7fffffff;
+    size_t const count = get32(p + 4);
+    if ((0 == count) || (count > LZWGC_EPACK_FRAME)) return 0;
+    if ((0 != (head & 0x80000000u)) ? (len != stored_size(count, u->bits))
+                                    : ((len < 5) || (len >= stored_size(count, u->bits))))
+        return 0;
+    return frame_header + len;
+}
+
+// next_frame starts the next frame if it has arrived in full, copying
+// any part that has not aside until it does
+static bool next_frame(lzwgc_eunpack* u) {
+    size_t const avail = u->size - u->pos;
+    unsigned char const * const p = u->data + u->pos;
+
+    if ((0 == u->carry_len) && (avail >= frame_header)) {
+        size_t const need = frame_size(u, p);
+        if (0 == need) { u->corrupt = true; return false; }
+        if (avail >= need) {
+            u->pos += need;
+            start_frame(u, p);
+            return true;
+        }
+    }
+    if (0 == avail)
+        return false;
+
+    // gather the header, then the rest of the frame
+    if (0 == u->carry) {
+        u->carry_cap = frame_header + lzwgc_pack_bound(LZWGC_EPACK_FRAME, u->bits);
+        u->carry = malloc(u->carry_cap);
+        assert(0 != u->carry);
+    }
+    size_t need = frame_header;
+    if (u->carry_len >= frame_header) need = frame_size(u, u->carry);
+    while (1) {
+        size_t take = need - u->carry_len;
+        if (take > (u->size - u->pos)) take = u->size - u->pos;
+        memcpy(u->carry + u->carry_len, u->data + u->pos, take);
+        u->carry_len += take;
+        u->pos += take;
+        if (u->carry_len < need)
+            return false;
+        if (frame_header == need) {
+            need = frame_size(u, u->carry);
+            if (0 == need) { u->corrupt = true; return false; }
+            continue;
+        }
+        u->carry_len = 0;
+        start_frame(u, u->carry);
+        return true;
+    }
+}
+
+size_t lzwgc_eunpack_tokens(lzwgc_eunpack* u, token_t* out, size_t cap) {
+    size_t ct = 0;
+    while ((ct < cap) && !u->corrupt) {
+        if (0 == u->left) {
+            if (!next_frame(u)) break;
+            continue;
+        }
+        size_t n = (u->left < (cap - ct)) ? u->left : (cap - ct);
+        if (u->stored) {
+            n = lzwgc_unpack_tokens(&(u->up), out + ct, n);
+        } else {
+            for (size_t ii = 0; ii < n; ++ii)
+                out[ct + ii] = decode_token(u);
+        }
+        if (u->corrupt || (0 == n)) { u->corrupt = true; break; }
+        ct += n;
+        u->left -= (uint32_t)n;
+    }
+    return ct;
+}
+
+void lzwgc_eunpack_fini(lzwgc_eunpack* u) {
+    free(u->carry);
+    u->carry = 0;
+}
@@ -0,0 +1,100 @@
+/*
+* Entropy coding for LZW-GC token streams, an alternative to lzwgc_pack.
+*
+* Tokens are few literals and many dictionary entries, and when they
+* are written as allocation ranks (lzwgc_dict_rank) the small ranks of
+* recently allocated entries dominate. An adaptive binary range coder
+* spends bits accordingly:
+*
+*   literal or not      one bit, in the context of the previous token
+*   literal             8 bit tree
+*   rank - 256          bit length (5 bit tree), then the 4 bits below
+*                       the leading one (a tree per length), then any
+*                       remaining low bits at even odds
+*
+* Tokens are coded in frames of up to LZWGC_EPACK_FRAME, each a little
+* endian u32 payload length (top bit set for a stored frame) and u32
+* token count, then the payload. The models carry over from frame to
+* frame, but the coder restarts, so a decoder needs whole frames in
+* hand and never reads past one. Where a frame would not come out
+* smaller than the tokens packed at a fixed width, it is stored that
+* way instead and the models are left as they were before it.
+*/
+
+#ifndef LZWGC_ENTROPY_H
+
+#include "lzwgc.h"
+#include "lzwgc_pack.h"
+
+#define LZWGC_EPACK_FRAME (1 << 16) // tokens per frame, at most
+#define LZWGC_EPACK_MID   4         // bits below the leading one with a model
+
+typedef struct
+{
+    uint16_t        is_lit[2];   // by whether the previous token was a literal
+    uint16_t        lit[256];
+    uint16_t        len[32];
+    uint16_t        mid[25][1 << LZWGC_EPACK_MID];
+    bool            prev_lit;
+} lzwgc_emodel;
+
+typedef struct
+{
+    lzwgc_emodel    model;
+    uint32_t        bits;      // token width
+    token_t       * frame;     // tokens of the frame being collected
+    size_t          pending;   // number of them
+
+    unsigned char * data;      // output buffer (caller owned)
+    size_t          size;      // bytes written to data
+    size_t          cap;       // capacity of data
+} lzwgc_epack;
+
+typedef struct
+{
+    lzwgc_emodel          model;
+    uint32_t              bits;      // token width
+    bool                  corrupt;   // bad frame; no more tokens
+
+    // frame being decoded
+    uint32_t              left;      // tokens still to come from it
+    bool                  stored;
+    lzwgc_unpack          up;        // stored frames
+    uint32_t              range;     // coded frames
+    uint32_t              code;
+    unsigned char const * in;
+    unsigned char const * in_end;
+
+    unsigned char const * data;      // input buffer (caller owned)
+    size_t                size;      // bytes available in data
+    size_t                pos;       // bytes consumed from data
+
+    unsigned char       * carry;     // a frame split between buffers
+    size_t                carry_len;
+    size_t                carry_cap;
+} lzwgc_eunpack;
+
+// upper bound on output bytes for `count` tokens, including the flush
+size_t lzwgc_epack_bound(size_t count, uint32_t bits);
+
+// packing writes a frame into `buf` whenever LZWGC_EPACK_FRAME tokens
+// have been collected. Callers drain it as for lzwgc_pack; draining
+// after every call of at most LZWGC_EPACK_FRAME tokens, a `cap` of
+// lzwgc_epack_bound(LZWGC_EPACK_FRAME, bits) always suffices. Returns
+// the number of tokens taken, fewer only if a frame did not fit.
+void lzwgc_epack_init(lzwgc_epack*, uint32_t bits, unsigned char* buf, size_t cap);
+size_t lzwgc_epack_tokens(lzwgc_epack*, token_t const*, size_t count);
+bool lzwgc_epack_flush(lzwgc_epack*); // write the last frame; false if it did not fit
+void lzwgc_epack_fini(lzwgc_epack*);
+
+// unpacking reads frames from buffers handed over by feed. A frame left
+// incomplete by one buffer is copied aside, so a stream may be fed in
+// any pieces; feed the next once tokens returns 0. `corrupt` is set if
+// a frame is malformed.
+void lzwgc_eunpack_init(lzwgc_eunpack*, uint32_t bits);
+void lzwgc_eunpack_feed(lzwgc_eunpack*, unsigned char const* buf, size_t size);
+size_t lzwgc_eunpack_tokens(lzwgc_eunpack*, token_t*, size_t cap); // returns tokens read
+void lzwgc_eunpack_fini(lzwgc_eunpack*);
+
+#define LZWGC_ENTROPY_H
+#endif
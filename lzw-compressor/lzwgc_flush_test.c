@@ -0,0 +1,140 @@
+#include "lzwgc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define input_len (96 << 10)
+
+// xorshift64, so every run sees the same input and flush points
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+// words from a small vocabulary, then a random 4KB block repeated, then
+// noise, so small dictionaries fill and churn within one input
+static void synth(unsigned char* b, size_t len) {
+    static char const * const words[] = {
+        "the ", "of ", "and ", "flush ", "token ", "dictionary ", "stream ", "peer ", "in ", "step "
+    };
+    uint64_t s = 0x9e3779b97f4a7c15ull;
+    size_t const third = len / 3;
+    size_t pos = 0;
+    while (pos < third) {
+        char const * w = words[rnd(&s) % (sizeof(words) / sizeof(words[0]))];
+        while ((pos < third) && (0 != *w)) b[pos++] = (unsigned char)*w++;
+    }
+    for (; pos < 2 * third; ++pos)
+        b[pos] = ((pos - third) < 4096) ? (unsigned char)(rnd(&s) >> 56) : b[pos - 4096];
+    for (; pos < len; ++pos)
+        b[pos] = (unsigned char)(rnd(&s) >> 56);
+}
+
+// same reports whether both dictionaries hold the same entries, history
+// and allocation point, which is all later tokens depend on
+static bool same(lzwgc_dict const* a, lzwgc_dict const* b) {
+    if ((a->alloc_idx != b->alloc_idx) || (a->hist_token != b->hist_token) || (a->used != b->used))
+        return false;
+    for (uint32_t ix = 0; ix < a->used; ++ix) {
+        if ((lzwgc_dict_prev(a, ix) != lzwgc_dict_prev(b, ix)) ||
+            (lzwgc_dict_count(a, ix) != lzwgc_dict_count(b, ix)) ||
+            (a->added_char[ix] != b->added_char[ix]))
+            return false;
+        if ((0 != a->first_char) && (a->first_char[ix] != b->first_char[ix]))
+            return false;
+    }
+    return true;
+}
+
+// one stream: feeds `in` a byte at a time, flushing at random points
+// (about one byte in 97, sometimes twice running), and hands every token
+// straight to a decompressor. After each flush the peer must have
+// decoded exactly the bytes sent and hold the same dictionary.
+static bool run(unsigned char const* in, size_t len, uint32_t bits, uint32_t policy, bool ranked,
+                unsigned char* out, size_t* flushes) {
+    lzwgc_compress c;
+    lzwgc_decompress d;
+    uint64_t s = 0x2545f4914f6cdd1dull ^ ((uint64_t)bits << 8) ^ policy;
+    size_t decoded = 0;
+    bool ok = true;
+
+    lzwgc_compress_init_gc(&c, (1 << bits) - 1, policy);
+    lzwgc_decompress_init_gc(&d, (1 << bits) - 1, policy);
+    c.ranked = ranked;
+    d.ranked = ranked;
+
+    for (size_t ii = 0; ok && (ii < len); ++ii) {
+        lzwgc_compress_recv(&c, in[ii]);
+        if (c.have_output) {
+            lzwgc_decompress_recv(&d, c.token_output);
+            memcpy(out + decoded, d.output_chars, d.output_count);
+            decoded += d.output_count;
+        }
+        if (0 != (rnd(&s) % 97))
+            continue;
+
+        uint32_t const times = 1 + (uint32_t)(rnd(&s) % 2);
+        for (uint32_t k = 0; k < times; ++k) {
+            lzwgc_compress_flush(&c);
+            if (c.have_output) {
+                ok = ok && (0 == k); // a second flush has nothing left to send
+                lzwgc_decompress_recv(&d, c.token_output);
+                memcpy(out + decoded, d.output_chars, d.output_count);
+                decoded += d.output_count;
+            }
+        }
+        (*flushes) += 1;
+        ok = ok && (decoded == (ii + 1)) && (0 == memcmp(in, out, decoded)) && same(&(c.dict), &(d.dict));
+    }
+
+    lzwgc_compress_fini(&c);
+    if (ok && c.have_output) {
+        lzwgc_decompress_recv(&d, c.token_output);
+        memcpy(out + decoded, d.output_chars, d.output_count);
+        decoded += d.output_count;
+    }
+    lzwgc_decompress_fini(&d);
+    return ok && (decoded == len) && (0 == memcmp(in, out, len));
+}
+
+/** LZW-GC flush test:
+ *  lzwgc_flush_test
+ *  Compresses generated input a byte at a time under every GC policy at
+ *  9, 12, 14, 16 and 20 bits, with plain tokens and allocation ranks,
+ *  flushing at random points, and checks after every flush that the
+ *  decompressor has output every byte so far and that both dictionaries
+ *  agree. Prints each failing case; exits non-zero if there were any.
+ */
+int main(void) {
+    static uint32_t const widths[] = { 9, 12, 14, 16, 20 };
+    static char const * const policy_name[LZWGC_GC_COUNT] = { "clock", "lazy", "lru" };
+    unsigned char * const in = malloc(input_len);
+    unsigned char * const out = malloc(input_len);
+    size_t flushes = 0;
+    uint32_t failed = 0;
+
+    if ((0 == in) || (0 == out)) {
+        printf("ERROR: Out of memory.\n");
+        return -1;
+    }
+    synth(in, input_len);
+
+    for (uint32_t p = 0; p < LZWGC_GC_COUNT; ++p) {
+        for (uint32_t w = 0; w < (sizeof(widths) / sizeof(widths[0])); ++w) {
+            for (uint32_t r = 0; r < 2; ++r) {
+                if (!run(in, input_len, widths[w], p, (1 == r), out, &flushes)) {
+                    printf("FAILED: %s at %u bits%s\n", policy_name[p], widths[w], r ? ", ranked" : "");
+                    failed += 1;
+                }
+            }
+        }
+    }
+    printf("%u of %u cases failed, %zu flushes checked\n",
+           failed, (uint32_t)(LZWGC_GC_COUNT * 2 * (sizeof(widths) / sizeof(widths[0]))), flushes);
+
+    free(in);
+    free(out);
+    return (0 == failed) ? 0 : -1;
+}
@@ -1,155 +1,592 @@
-
 #include "lzwgc.h"
+#include "lzwgc_pack.h"
+#include "lzwgc_entropy.h"
+#include "lzwgc_container.h"
+#include "lzwgc_par.h"
+#include "lzwgc_pipe.h"
+#include "lzwgc_batch.h"
+#include "lzwgc_reader.h"
+#include "lzwgc_map.h"
+#include "lzwgc_preset.h"
+#include "lzwgc_compat.h"
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 
-#define buff_size 1
+#define block_size (1 << 16)
+#define extract_size (64 << 20) // bytes of an archive x expands per read
+
+// copy_chunk streams a stored chunk from input to output.
+bool copy_chunk(FILE* in, FILE* out, lzwgc_chunk_entry const* entry) {
+    unsigned char * const buff = malloc(block_size);
+    uint64_t remaining = entry->comp_len;
+    uint32_t checksum = 1;
+    size_t len;
+
+    bool const seek = (0 == lzwgc_fseek64(in, (int64_t)entry->offset, SEEK_SET));
+    while (seek && (remaining > 0)) {
+        len = (remaining < block_size) ? (size_t)remaining : block_size;
+        len = fread(buff, 1, len, in);
+        if (0 == len) break;
+        remaining -= len;
+        checksum = lzwgc_adler32(checksum, buff, len);
+        fwrite(buff, 1, len, out);
+    }
+    free(buff);
 
-// for now, write tokens unpacked bigendian, 2-3 octets
-void write_token(FILE* out, token_t tok, int bits) {
-    int const t16 = (tok >> 16) & 0xff;
-    int const t8 = (tok >> 8) & 0xff;
-    int const t0 = tok & 0xff;
-    if (bits > 16) fputc(t16, out);
-    fputc(t8, out);
-    fputc(t0, out);
+    return seek && (0 == remaining) && (entry->comp_len == entry->raw_len) && (checksum == entry->checksum);
 }
-bool read_token(FILE* in, token_t* tok, int bits) {
-    int t16 = 0;
-    int t8 = 0;
-    int t0 = 0;
-    if (bits > 16) t16 = fgetc(in);
-    t8 = fgetc(in);
-    t0 = fgetc(in);
-    (*tok) = ((t16 & 0xff) << 16) + ((t8 & 0xff) << 8) + (t0 & 0xff);
-    return (t16 != EOF) && (t8 != EOF) && (t0 != EOF);
-}
-
 
-// compress will process input to output.
-// this uses the knowledge that N inputs can produce at most N outputs. 
-/*void compress(FILE* in, FILE* out, int bits, unsigned long start, unsigned long offset) {
-    lzwgc_compress st;
-    uint32_t const dict_size = (1 << bits) - 1; // reserve top token for client
-
-    int read_buff;
-    //unsigned long len;
-    bool isLoop;
-
-    fseek(in, start, SEEK_SET);
+// decompress_chunk streams one chunk from input to output.
+bool decompress_chunk(FILE* in, FILE* out, lzwgc_header const* hdr, lzwgc_dict const* preset,
+                      lzwgc_chunk_entry const* entry) {
+    lzwgc_decompress st;
+    lzwgc_unpack up;
+    lzwgc_eunpack eu;
+    uint32_t const dict_size = (1 << hdr->bits) - 1; // reserve top token for client
+    bool const entropy = (0 != (hdr->flags & LZWGC_FLAG_ENTROPY));
+    if (0 != preset)
+        lzwgc_decompress_init_dict(&st, preset);
+    else
+        lzwgc_decompress_init_gc(&st, dict_size, hdr->gc_policy);
+    st.ranked = entropy;
+    if (entropy)
+        lzwgc_eunpack_init(&eu, hdr->bits);
+    else
+        lzwgc_unpack_init(&up, hdr->bits, (0 != (hdr->flags & LZWGC_FLAG_GROW)));
+
+    // a single token may expand to a full dictionary string
+    size_t const out_cap = block_size + dict_size;
+    unsigned char * const read_buff = malloc(block_size);
+    token_t * const tok_buff = malloc(block_size * sizeof(token_t));
+    unsigned char * const write_buff = malloc(out_cap);
+    uint64_t remaining = entry->comp_len;
+    uint64_t written = 0;
+    uint32_t checksum = 1;
+    size_t ntok, pos, used, len;
+    bool valid = (0 == lzwgc_fseek64(in, (int64_t)entry->offset, SEEK_SET));
+
+    while (valid && (remaining > 0)) {
+        len = (remaining < block_size) ? (size_t)remaining : block_size;
+        len = fread(read_buff, 1, len, in);
+        if (0 == len) break;
+        remaining -= len;
+
+        if (entropy) lzwgc_eunpack_feed(&eu, read_buff, len);
+        else lzwgc_unpack_feed(&up, read_buff, len);
+        while (valid && (0 != (ntok = entropy ? lzwgc_eunpack_tokens(&eu, tok_buff, block_size)
+                                              : lzwgc_unpack_tokens(&up, tok_buff, block_size)))) {
+            pos = 0;
+            while (pos < ntok) {
+                len = lzwgc_decompress_block(&st, tok_buff + pos, ntok - pos, write_buff, out_cap, &used);
+                checksum = lzwgc_adler32(checksum, write_buff, len);
+                written += len;
+                fwrite(write_buff, 1, len, out);
+                if (0 == used) { valid = false; break; }
+                pos += used;
+            }
+        }
+    }
+    if (entropy) {
+        valid = valid && !eu.corrupt;
+        lzwgc_eunpack_fini(&eu);
+    }
+    lzwgc_decompress_fini(&st);
 
-    lzwgc_compress_init(&st, dict_size);
-    
-    while (true) {
-        if (feof(in)) break;
-        if (offset) if (ftell(in) >= start + offset) break;
+    free(read_buff);
+    free(tok_buff);
+    free(write_buff);
 
-        read_buff = fgetc(in);
-        if (read_buff == EOF) break;
-        lzwgc_compress_recv(&st, read_buff);
+    return valid && (0 == remaining) &&
+        (written == entry->raw_len) && (checksum == entry->checksum);
+}
 
-        if (st.have_output) {
-            write_token(out, st.token_output, bits);
+// decompress will expand every chunk of input in order.
+bool decompress(FILE* in, FILE* out, lzwgc_dict const* preset, uint32_t dict_id) {
+    unsigned char buf[LZWGC_ENTRY_SIZE];
+    lzwgc_header hdr;
+    lzwgc_trailer tr;
+    lzwgc_chunk_entry entry;
+    uint32_t i;
+
+    if ((fread(buf, 1, LZWGC_HEADER_SIZE, in) != LZWGC_HEADER_SIZE) || !lzwgc_header_decode(&hdr, buf))
+        return false;
+    if (hdr.dict_id != dict_id)
+        return false;
+    if ((0 != lzwgc_fseek64(in, -LZWGC_TRAILER_SIZE, SEEK_END)) ||
+        (fread(buf, 1, LZWGC_TRAILER_SIZE, in) != LZWGC_TRAILER_SIZE) || !lzwgc_trailer_decode(&tr, buf))
+        return false;
+
+    for (i = 0; i < tr.chunk_count; i++) {
+        if ((0 != lzwgc_fseek64(in, (int64_t)(tr.index_offset + ((uint64_t)i * LZWGC_ENTRY_SIZE)), SEEK_SET)) ||
+            (fread(buf, 1, LZWGC_ENTRY_SIZE, in) != LZWGC_ENTRY_SIZE))
+            return false;
+        lzwgc_entry_decode(&entry, buf);
+        if (LZWGC_CHUNK_STORED == entry.type) {
+            if (!copy_chunk(in, out, &entry))
+                return false;
+        } else if ((LZWGC_CHUNK_TOKENS != entry.type) ||
+                   !decompress_chunk(in, out, &hdr, (0 != dict_id) ? preset : 0, &entry)) {
+            return false;
         }
     }
+    return true;
+}
 
-    lzwgc_compress_fini(&st);
-    if (st.have_output) {
-        write_token(out, st.token_output, bits);
-    }
-
-    write_token(out, 0xffff, bits);
+bool write_sink(void* ctx, unsigned char const* data, size_t len) {
+    return (fwrite(data, 1, len, (FILE*)ctx) == len);
 }
 
-void decompress(FILE* in, FILE* out, int bits, unsigned long start) {
-    lzwgc_decompress st;
-    uint32_t const dict_size = (1 << bits) - 1; // reserve top token for client
-    lzwgc_decompress_init(&st, dict_size);
-    token_t tok;
+size_t read_source(void* ctx, unsigned char* buf, size_t cap) {
+    return fread(buf, 1, cap, (FILE*)ctx);
+}
 
-    fseek(in, start, SEEK_SET);
+// par_compress splits input into chunks compressed on `threads` threads.
+// all threads share one read-only mapping of the input.
+bool par_compress(char const* path, FILE* out, lzwgc_par_opts const* opts, uint32_t threads) {
+    lzwgc_pool *pool;
+    lzwgc_map in;
+    bool ok;
+
+    if (!lzwgc_map_open(&in, path, 0, 0, LZWGC_MAP_SEQUENTIAL | LZWGC_MAP_HUGEPAGE))
+        return false;
+    pool = lzwgc_pool_create(threads);
+    ok = lzwgc_par_compress(pool, opts, in.data, in.size, write_sink, out);
+    lzwgc_pool_destroy(pool);
+    lzwgc_map_close(&in);
+    return ok;
+}
 
-    while (read_token(in, &tok, bits)) {
-        if (tok == 0xffff) break;
-        lzwgc_decompress_recv(&st, tok);
-        fwrite(st.output_chars, 1, st.output_count, out);
+// par_decompress expands all chunks on `threads` threads.
+bool par_decompress(char const* path, FILE* out, uint32_t threads, lzwgc_dict const* preset, uint32_t dict_id) {
+    lzwgc_pool *pool;
+    lzwgc_header hdr;
+    lzwgc_trailer tr;
+    lzwgc_map in;
+    unsigned char *raw = 0;
+    size_t raw_len = 0;
+    bool ok;
+
+    if (!lzwgc_map_open(&in, path, 0, 0, 0))
+        return false;
+    ok = lzwgc_container_parse(in.data, in.size, &hdr, &tr) && (hdr.dict_id == dict_id);
+    if (ok) {
+        raw_len = (size_t)lzwgc_container_raw_size(in.data, &tr);
+        raw = malloc((raw_len > 0) ? raw_len : 1);
+        pool = lzwgc_pool_create(threads);
+        ok = lzwgc_par_decompress_dict(pool, (0 != dict_id) ? preset : 0, in.data, in.size, raw, raw_len) &&
+            (fwrite(raw, 1, raw_len, out) == raw_len);
+        lzwgc_pool_destroy(pool);
     }
-    lzwgc_decompress_fini(&st);
+    lzwgc_map_close(&in);
+    free(raw);
+    return ok;
 }
 
-int marker(unsigned long *pos, FILE *in) {
-    int sum;
-    uint16_t buf;
-    unsigned long lastpos;
-
-    lastpos = ftell(in);
-    fseek(in, 0, SEEK_SET);
-    sum = 0;
-
-    while (fread(&buf, 2, 1, in)) {
-        if (buf == 0xffff) {
-            printf("Mark on %d\n", ftell(in));
-            pos[sum++] = ftell(in);
+typedef struct
+{
+    char          * text;
+    char         ** in;
+    char         ** out;      // each in + ".lzw" unless the line names one
+    size_t          count;
+} batch_list;
+
+// read_list loads a list for b or x: one input file per line, each
+// optionally followed by a tab and the file to compress it to.
+bool read_list(char const* path, batch_list* l) {
+    lzwgc_map m;
+    if (!lzwgc_map_open(&m, path, 0, 0, LZWGC_MAP_SEQUENTIAL))
+        return false;
+    size_t const len = m.size;
+    l->text = malloc(len + 1);
+    assert(0 != l->text);
+    memcpy(l->text, m.data, len);
+    l->text[len] = '\n';
+    lzwgc_map_close(&m);
+
+    size_t lines = 0;
+    for (size_t pos = 0; pos <= len; ++pos)
+        lines += ('\n' == l->text[pos]) ? 1 : 0;
+    l->in = malloc(lines * sizeof(char*));
+    l->out = malloc(lines * sizeof(char*));
+    assert((0 != l->in) && (0 != l->out));
+    l->count = 0;
+
+    char * line = l->text;
+    for (size_t pos = 0; pos <= len; ++pos) {
+        if ('\n' != l->text[pos]) continue;
+        l->text[pos] = 0;
+        if ((pos > 0) && ('\r' == l->text[pos - 1])) l->text[pos - 1] = 0;
+        char * const tab = strchr(line, '\t');
+        if (0 != tab) (*tab) = 0;
+        if (0 != line[0]) {
+            size_t const n = strlen(line);
+            char * const out = malloc(((0 != tab) ? strlen(tab + 1) : (n + 4)) + 1);
+            assert(0 != out);
+            if (0 != tab) strcpy(out, tab + 1);
+            else { memcpy(out, line, n); memcpy(out + n, ".lzw", 5); }
+            l->in[l->count] = line;
+            l->out[l->count] = out;
+            l->count += 1;
         }
+        line = l->text + pos + 1;
     }
+    return true;
+}
 
-    fseek(in, lastpos, SEEK_SET);
+void free_list(batch_list* l) {
+    for (size_t ii = 0; ii < l->count; ++ii)
+        free(l->out[ii]);
+    free(l->in);
+    free(l->out);
+    free(l->text);
+}
 
-    return sum;
+// batch compresses every file of a list on `threads` threads, each to
+// its own file, or all to one archive when `archive` is given.
+bool batch(char const* list_path, char const* archive, lzwgc_par_opts const* opts, uint32_t threads) {
+    batch_list l;
+    lzwgc_batch b;
+    lzwgc_pool *pool;
+    FILE *out;
+    bool ok;
+
+    if (!read_list(list_path, &l)) {
+        printf("ERROR: Cannot open file %s.", list_path);
+        return false;
+    }
+    pool = lzwgc_pool_create(threads);
+    lzwgc_batch_init(&b, pool, opts);
+    if (0 != archive) {
+        size_t unread = l.count;
+        ok = (0 != (out = lzwgc_fopen(archive, "wb")));
+        if (ok) {
+            ok = lzwgc_batch_archive(&b, (char const* const*)l.in, l.count, write_sink, out, &unread);
+            ok = (0 == fclose(out)) && ok;
+        }
+        if (unread < l.count) printf("ERROR: Cannot open file %s.", l.in[unread]);
+        else if (!ok) printf("ERROR: Cannot write file %s.", archive);
+    } else {
+        bool * const done = malloc((l.count + 1) * sizeof(bool));
+        assert(0 != done);
+        ok = lzwgc_batch_files(&b, (char const* const*)l.in, (char const* const*)l.out, l.count, done);
+        for (size_t ii = 0; ii < l.count; ++ii) {
+            if (!done[ii]) printf("ERROR: Cannot compress file %s to %s.\n", l.in[ii], l.out[ii]);
+        }
+        free(done);
+    }
+    lzwgc_batch_fini(&b);
+    lzwgc_pool_destroy(pool);
+    free_list(&l);
+    return ok;
 }
 
-int main(int argc, char const * args[]) {
-    FILE *fin, *fout1, *fout2;
-    unsigned long fsize, fhalf, rem;
-    unsigned long mark[16];
-    int marklen;
+// extract expands an archive made by b back to the files of its list,
+// up to extract_size bytes of them at a time on `threads` threads.
+bool extract(char const* list_path, char const* archive, uint32_t threads,
+             lzwgc_dict const* preset, uint32_t dict_id) {
+    batch_list l;
+    lzwgc_reader r;
+    lzwgc_pool *pool;
+    lzwgc_map in;
+    FILE *out;
+
+    if (!read_list(list_path, &l)) {
+        printf("ERROR: Cannot open file %s.", list_path);
+        return false;
+    }
+    if (!lzwgc_map_open(&in, archive, 0, 0, 0)) {
+        printf("ERROR: Cannot open file %s.", archive);
+        free_list(&l);
+        return false;
+    }
+    pool = lzwgc_pool_create(threads);
+    bool ok = lzwgc_reader_init(&r, pool, (0 != dict_id) ? preset : 0, in.data, in.size, 0);
+    if (ok) {
+        ok = (r.chunk_count == l.count) && (r.hdr.dict_id == dict_id);
+        if (!ok) lzwgc_reader_fini(&r);
+    }
+    if (!ok) {
+        printf("ERROR: File %s is corrupt or not an archive of %s.", archive, list_path);
+        lzwgc_pool_destroy(pool);
+        lzwgc_map_close(&in);
+        free_list(&l);
+        return false;
+    }
+
+    unsigned char *buf = 0;
+    size_t cap = 0;
+    for (size_t first = 0; ok && (first < l.count); ) {
+        size_t last = first + 1;
+        while ((last < l.count) && ((r.raw_offset[last + 1] - r.raw_offset[first]) <= extract_size))
+            last += 1;
+        size_t const len = (size_t)(r.raw_offset[last] - r.raw_offset[first]);
+        if (cap < len) {
+            free(buf);
+            buf = malloc(len);
+            cap = len;
+            assert(0 != buf);
+        }
+        ok = lzwgc_reader_read(&r, r.raw_offset[first], buf, len);
+        if (!ok) printf("ERROR: File %s is corrupt.", archive);
+        for (size_t ii = first; ok && (ii < last); ++ii) {
+            size_t const n = (size_t)(r.raw_offset[ii + 1] - r.raw_offset[ii]);
+            ok = (0 != (out = lzwgc_fopen(l.in[ii], "wb")));
+            if (ok) {
+                ok = (fwrite(buf + (r.raw_offset[ii] - r.raw_offset[first]), 1, n, out) == n);
+                ok = (0 == fclose(out)) && ok;
+            }
+            if (!ok) printf("ERROR: Cannot write file %s.", l.in[ii]);
+        }
+        first = last;
+    }
 
-    fopen_s(&fin, "image.tif", "rb");
-    fopen_s(&fout1, "comp0.bin", "wb");
-    fopen_s(&fout2, "comp1.bin", "wb");
+    free(buf);
+    lzwgc_reader_fini(&r);
+    lzwgc_pool_destroy(pool);
+    lzwgc_map_close(&in);
+    free_list(&l);
+    return ok;
+}
 
-    fseek(fin, 0, SEEK_END);
-    fsize = ftell(fin);
-    fseek(fin, 0, SEEK_SET);
+// train builds a preset dictionary from sample files and saves it.
+bool train(char const* path, char * const samples[], int count, uint32_t bits, uint32_t gc_policy) {
+    lzwgc_dict dict;
+    lzwgc_map m;
+    FILE *out;
+    bool ok = true;
+
+    lzwgc_dict_init_gc(&dict, (1 << bits) - 1, gc_policy);
+    for (int i = 0; ok && (i < count); i++) {
+        ok = lzwgc_map_open(&m, samples[i], 0, 0, LZWGC_MAP_SEQUENTIAL);
+        if (!ok) {
+            printf("ERROR: Cannot open file %s.", samples[i]);
+            break;
+        }
+        lzwgc_dict_train(&dict, m.data, m.size);
+        lzwgc_map_close(&m);
+    }
 
-    printf("The file size is %ld\n", fsize);
-    fhalf = fsize / 2;
-    
-    compress(fin, fout1, 16, 0, fhalf);
-    compress(fin, fout2, 16, fhalf, 0);
+    if (ok) {
+        size_t const len = lzwgc_preset_size(&dict);
+        unsigned char * const buf = malloc(len);
+        assert(0 != buf);
+        lzwgc_preset_save(&dict, buf);
+        ok = (0 != (out = lzwgc_fopen(path, "wb")));
+        if (ok) {
+            ok = (fwrite(buf, 1, len, out) == len);
+            fclose(out);
+        }
+        if (!ok) printf("ERROR: Cannot write file %s.", path);
+        free(buf);
+    }
+    lzwgc_dict_fini(&dict);
+    return ok;
+}
 
-    fsize = ftell(fout1);
-    printf("Output 1 file size is %ld\n", fsize);
-    fsize = ftell(fout2);
-    printf("Output 2 file size is %ld\n", fsize);
+// load_preset reads a dictionary saved by train.
+bool load_preset(char const* path, lzwgc_dict* dict, uint32_t* id) {
+    lzwgc_map m;
+    if (!lzwgc_map_open(&m, path, 0, 0, 0))
+        return false;
+    bool const ok = lzwgc_preset_load(dict, m.data, m.size);
+    (*id) = lzwgc_preset_id(m.data, m.size);
+    lzwgc_map_close(&m);
+    return ok;
+}
 
-    fclose(fin);
-    fclose(fout1);
-    fclose(fout2);
+// print_stats reports what every dictionary did, for --stats
+void print_stats(void) {
+    lzwgc_stats s;
+    if (!lzwgc_stats_total(&s)) {
+        printf("Statistics are not built in; rebuild with LZWGC_STATS defined.\n");
+        return;
+    }
 
+    unsigned long long probes = 0;
+    printf("lookups       %llu (%.1f%% matched)\n", (unsigned long long)s.lookups,
+           (s.lookups > 0) ? (100.0 * s.found) / s.lookups : 0);
+    printf("probe length ");
+    for (uint32_t ii = 0; ii < LZWGC_STATS_PROBES; ++ii) {
+        probes += (ii + 1) * s.probes[ii];
+        if (0 != s.probes[ii])
+            printf(" %u%s:%llu", ii + 1, ((ii + 1) == LZWGC_STATS_PROBES) ? "+" : "",
+                   (unsigned long long)s.probes[ii]);
+    }
+    printf("\nmean probe    %.3f slots\n", (s.lookups > 0) ? (double)probes / s.lookups : 0);
+    printf("hashtable     %llu rebuilds in %.3fms, %llu slots shifted back, no tombstones\n",
+           (unsigned long long)s.rebuilds, s.rebuild_ns / 1e6, (unsigned long long)s.shifts);
+    printf("updates       %llu, %llu evicting a string (turnover %.1f%%)\n",
+           (unsigned long long)s.updates, (unsigned long long)s.evictions,
+           (s.updates > 0) ? (100.0 * s.evictions) / s.updates : 0);
+    printf("sweep         mean %.3f, max %llu entries\n",
+           (s.updates > 0) ? (double)s.sweep / s.updates : 0, (unsigned long long)s.sweep_max);
+    printf("chain         mean %.3f, max %llu entries\n",
+           (s.updates > 0) ? (double)s.chain / s.updates : 0, (unsigned long long)s.chain_max);
+}
 
-    fopen_s(&fin, "comp.bin", "rb");
-    fopen_s(&fout1, "decomp.tif", "wb");
-    //fopen_s(&fout2, "decomp2.tif", "wb");
+/** LZW-GC compressor, serial or threaded, no MPI required:
+ *  lzwgc c|d [-b bits] [-g|-e] [-p policy] [-D dict] [-t threads|-P] [-k chunk_kb] [--stats] file.in file.out
+ *  lzwgc t [-b bits] [-p policy] [--stats] dict.out sample ...
+ *  lzwgc b [-b bits] [-g|-e] [-p policy] [-D dict] [-t threads] [--stats] list [archive.out]
+ *  lzwgc x [-D dict] [-t threads] list archive.in
+ *  -b token width, 9 to 24 (default 16)
+ *  -g pack tokens at a width that grows with the dictionary
+ *  -e entropy code the tokens instead (smaller, slower)
+ *  -p dictionary GC policy, 0 clock (default), 1 lazy or 2 lru
+ *  -D start from a preset dictionary made by t, which fixes -b and -p
+ *  -t split into chunks and use this many threads (0 for all cores)
+ *  -k chunk size for -t in KB (default 4096); chunks that would not shrink are stored
+ *  -P compress as c does, reading, compressing and writing on separate threads
+ *  c without -t stores each 64KB block that looks incompressible as it is, and codes
+ *    runs of the others as chunks, storing what would not shrink
+ *  b compresses each file named in list, one per line, as one chunk on a thread pool
+ *    (-t, default all cores) reusing a dictionary per thread: to the file after a
+ *    tab on its line, else to the name plus .lzw, or all into one archive
+ *  x expands an archive made by b back to the files named in the same list
+ *  --stats report dictionary statistics (a build with LZWGC_STATS)
+ *  Width, packing, coding and policy are recorded in the header, so d needs none;
+ *  a stream made with -D must be expanded with the same dictionary.
+ */
+int main(int argc, char * argv[]) {
+    FILE *in, *out;
+    lzwgc_par_opts opts;
+    lzwgc_header hdr;
+    lzwgc_dict preset;
+    char const *preset_path = 0;
+    bool threaded = false;
+    bool piped = false;
+    bool stats = false;
+    uint32_t threads = 0;
+    bool ok = true;
+    int i;
+
+    lzwgc_par_defaults(&opts);
+    for (i = 2; (i < argc) && (argv[i][0] == '-'); i++) {
+        if (0 == strcmp(argv[i], "--stats")) {
+            stats = true;
+        } else if (argv[i][1] == 'g') {
+            opts.flags |= LZWGC_FLAG_GROW;
+        } else if (argv[i][1] == 'e') {
+            opts.flags |= LZWGC_FLAG_ENTROPY;
+        } else if (argv[i][1] == 'P') {
+            piped = true;
+        } else if ((i + 1) == argc) {
+            break;
+        } else if (argv[i][1] == 'b') {
+            opts.bits = atoi(argv[++i]);
+        } else if (argv[i][1] == 't') {
+            threaded = true;
+            threads = atoi(argv[++i]);
+        } else if (argv[i][1] == 'p') {
+            opts.gc_policy = atoi(argv[++i]);
+        } else if (argv[i][1] == 'k') {
+            opts.chunk_size = (size_t)atoi(argv[++i]) << 10;
+        } else if (argv[i][1] == 'D') {
+            preset_path = argv[++i];
+        } else {
+            break;
+        }
+    }
 
-    marklen = marker(mark, fin);
+    int const args = argc - i;
+    if ((argc < 2) ||
+        ((argv[1][0] == 't') ? (args < 2) : (argv[1][0] == 'b') ? ((args < 1) || (args > 2)) : (args != 2))) {
+        printf("ERROR: Argument required.");
+        return -1;
+    }
+    if ((opts.bits < 9) || (opts.bits > 24)) {
+        printf("ERROR: Token width must be 9 to 24 bits.");
+        return -1;
+    }
+    if (opts.gc_policy >= LZWGC_GC_COUNT) {
+        printf("ERROR: Unknown GC policy %u.", opts.gc_policy);
+        return -1;
+    }
+    if ((opts.flags & LZWGC_FLAG_GROW) && (opts.flags & LZWGC_FLAG_ENTROPY)) {
+        printf("ERROR: Entropy coding replaces growing token widths; use -g or -e.");
+        return -1;
+    }
+    if (threaded && piped) {
+        printf("ERROR: -P keeps one chunk; use -t or -P.");
+        return -1;
+    }
+    if (0 == opts.chunk_size) {
+        printf("ERROR: Chunk size must be at least 1KB.");
+        return -1;
+    }
 
-    decompress(fin, fout1, 16, 0);
-    decompress(fin, fout1, 16, mark[0]);
+    if (argv[1][0] == 't') {
+        ok = train(argv[i], argv + i + 1, argc - i - 1, opts.bits, opts.gc_policy);
+        if (ok && stats) print_stats();
+        return ok ? 0 : -1;
+    }
 
-    fsize = ftell(fout1);
-    printf("Output file size is %ld\n", fsize);
+    if (0 != preset_path) {
+        if (!load_preset(preset_path, &preset, &opts.dict_id)) {
+            printf("ERROR: Dictionary %s is corrupt.", preset_path);
+            return -1;
+        }
+        opts.preset = &preset;
+        opts.bits = lzwgc_token_bits(preset.size);
+        opts.gc_policy = preset.gc_policy;
+        if (((uint32_t)(1 << opts.bits) - 1) != preset.size) {
+            printf("ERROR: Dictionary %s does not match a token width.", preset_path);
+            return -1;
+        }
+        if (opts.flags & LZWGC_FLAG_GROW) {
+            printf("ERROR: A preset dictionary needs a fixed token width.");
+            return -1;
+        }
+    }
 
-    fclose(fin);
-    fclose(fout1);
-    //fclose(fout2);
+    if (argv[1][0] == 'b')
+        ok = batch(argv[i], (2 == args) ? argv[i + 1] : 0, &opts, threads);
+    else if (argv[1][0] == 'x')
+        ok = extract(argv[i], argv[i + 1], threads, opts.preset, opts.dict_id);
+    if ((argv[1][0] == 'b') || (argv[1][0] == 'x')) {
+        if (0 != opts.preset) lzwgc_dict_fini(&preset);
+        if (ok && stats) print_stats();
+        return ok ? 0 : -1;
+    }
 
-    return 0;
-}*/
+    if (0 == (in = lzwgc_fopen(argv[i], "rb"))) {
+        printf("ERROR: Cannot open file %s.", argv[i]);
+        return -1;
+    }
+    if (0 == (out = lzwgc_fopen(argv[i + 1], "wb"))) {
+        printf("ERROR: Cannot open file %s.", argv[i + 1]);
+        fclose(in);
+        return -1;
+    }
 
+    if (argv[1][0] == 'c') {
+        if (threaded) {
+            ok = par_compress(argv[i], out, &opts, threads);
+        } else {
+            lzwgc_header_init(&hdr, opts.bits, opts.flags);
+            hdr.gc_policy = opts.gc_policy;
+            hdr.dict_id = opts.dict_id;
+            if (piped)
+                ok = lzwgc_pipe_compress(&hdr, opts.preset, read_source, in, write_sink, out);
+            else
+                ok = lzwgc_stream_compress(&hdr, opts.preset, read_source, in, write_sink, out);
+        }
+        if (!ok) printf("ERROR: Cannot write file %s.", argv[i + 1]);
+    } else if (argv[1][0] == 'd') {
+        ok = threaded ? par_decompress(argv[i], out, threads, opts.preset, opts.dict_id)
+                      : decompress(in, out, opts.preset, opts.dict_id);
+        if (!ok) printf("ERROR: File %s is corrupt.", argv[i]);
+    } else {
+        printf("ERROR: Job argument (c|d|t) required.");
+    }
 
+    fclose(in);
+    fclose(out);
+    if (0 != opts.preset) lzwgc_dict_fini(&preset);
+    if (ok && stats) print_stats();
 
- 
\ No newline at end of file
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,151 @@
+
+
+#include "lzwgc_map.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define huge_page (2 << 20)
+
+static void map_empty(lzwgc_map* m) {
+    static unsigned char const nothing[1] = { 0 };
+    m->data = nothing;
+    m->size = 0;
+    m->base = 0;
+    m->base_size = 0;
+}
+
+#ifdef _WIN32
+
+bool lzwgc_map_open(lzwgc_map* m, char const* path, uint64_t offset, uint64_t length, uint32_t flags) {
+    SYSTEM_INFO si;
+    LARGE_INTEGER fsize;
+    DWORD const hint = (flags & LZWGC_MAP_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+
+    map_empty(m);
+    m->file = 0;
+    m->mapping = 0;
+
+    HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, hint, 0);
+    if (INVALID_HANDLE_VALUE == file) return false;
+    if (!GetFileSizeEx(file, &fsize)) { CloseHandle(file); return false; }
+
+    uint64_t const end = (uint64_t)fsize.QuadPart;
+    if (offset > end) offset = end;
+    if ((0 == length) || (length > (end - offset))) length = end - offset;
+    if (0 == length) { CloseHandle(file); return true; }
+
+    // views must start on the allocation granularity
+    GetSystemInfo(&si);
+    uint64_t const base_offset = offset - (offset % si.dwAllocationGranularity);
+    size_t const base_size = (size_t)(length + (offset - base_offset));
+
+    HANDLE const mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (0 == mapping) { CloseHandle(file); return false; }
+    void * const base = MapViewOfFile(mapping, FILE_MAP_READ,
+                                      (DWORD)(base_offset >> 32), (DWORD)base_offset, base_size);
+    if (0 == base) { CloseHandle(mapping); CloseHandle(file); return false; }
+
+    m->file = file;
+    m->mapping = mapping;
+    m->base = base;
+    m->base_size = base_size;
+    m->data = (unsigned char const*)base + (offset - base_offset);
+    m->size = (size_t)length;
+    return true;
+}
+
+void lzwgc_map_close(lzwgc_map* m) {
+    if (0 != m->base) UnmapViewOfFile(m->base);
+    if (0 != m->mapping) CloseHandle(m->mapping);
+    if (0 != m->file) CloseHandle(m->file);
+    map_empty(m);
+    m->file = 0;
+    m->mapping = 0;
+}
+
+#else
+
+// reserve enough address space to put the mapping where file offsets
+// and virtual addresses agree modulo the huge page size
+static void* huge_aligned_addr(uint64_t base_offset, size_t base_size, void** rsv, size_t* rsv_size) {
+    (*rsv_size) = base_size + huge_page;
+    (*rsv) = mmap(0, *rsv_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == (*rsv)) { (*rsv) = 0; return 0; }
+    uintptr_t const lo = (uintptr_t)(*rsv);
+    uintptr_t const skew = (uintptr_t)(base_offset % huge_page);
+    uintptr_t addr = ((lo + huge_page - 1) & ~(uintptr_t)(huge_page - 1)) + skew;
+    if (addr >= (lo + huge_page)) addr -= huge_page;
+    return (void*)addr;
+}
+
+bool lzwgc_map_open(lzwgc_map* m, char const* path, uint64_t offset, uint64_t length, uint32_t flags) {
+    struct stat st;
+
+    map_empty(m);
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    if (0 != fstat(fd, &st)) { close(fd); return false; }
+
+    uint64_t const end = (uint64_t)st.st_size;
+    if (offset > end) offset = end;
+    if ((0 == length) || (length > (end - offset))) length = end - offset;
+    if (0 == length) { close(fd); return true; }
+
+    // mappings must start on a page boundary
+    uint64_t const page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t const base_offset = offset - (offset % page);
+    size_t const base_size = (size_t)(length + (offset - base_offset));
+
+    void * rsv = 0;
+    size_t rsv_size = 0;
+    void * addr = 0;
+    int mflags = MAP_PRIVATE;
+    if (flags & LZWGC_MAP_HUGEPAGE) {
+        addr = huge_aligned_addr(base_offset, base_size, &rsv, &rsv_size);
+        if (0 != addr) mflags |= MAP_FIXED;
+    }
+
+    void * const base = mmap(addr, base_size, PROT_READ, mflags, fd, (off_t)base_offset);
+    close(fd); // the mapping keeps its own reference
+    if (MAP_FAILED == base) {
+        if (0 != rsv) munmap(rsv, rsv_size);
+        return false;
+    }
+
+    // give back the reservation around a fixed mapping
+    if (0 != rsv) {
+        uintptr_t const lo = (uintptr_t)rsv;
+        uintptr_t const hi = lo + rsv_size;
+        uintptr_t const b0 = (uintptr_t)base;
+        uintptr_t const b1 = (b0 + base_size + page - 1) & ~(uintptr_t)(page - 1);
+        if (b0 > lo) munmap(rsv, b0 - lo);
+        if (hi > b1) munmap((void*)b1, hi - b1);
+    }
+
+#ifdef MADV_SEQUENTIAL
+    if (flags & LZWGC_MAP_SEQUENTIAL) madvise(base, base_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+    if (flags & LZWGC_MAP_HUGEPAGE) madvise(base, base_size, MADV_HUGEPAGE);
+#endif
+
+    m->base = base;
+    m->base_size = base_size;
+    m->data = (unsigned char const*)base + (offset - base_offset);
+    m->size = (size_t)length;
+    return true;
+}
+
+void lzwgc_map_close(lzwgc_map* m) {
+    if (0 != m->base) munmap(m->base, m->base_size);
+    map_empty(m);
+}
+
+#endif
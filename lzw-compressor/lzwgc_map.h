@@ -0,0 +1,44 @@
+/*
+* Read-only memory mapping of a file, or of a byte range within it.
+*
+* The mapped bytes can be handed straight to the block or chunk APIs,
+* and since the mapping is never written it may be shared by any number
+* of threads compressing different chunks of the same file.
+*
+* LZWGC_MAP_SEQUENTIAL asks the OS to read ahead aggressively.
+* LZWGC_MAP_HUGEPAGE places the mapping so that file offsets line up
+* with 2MB pages and asks for transparent huge pages where supported
+* (Linux); elsewhere it is ignored.
+*/
+
+#ifndef LZWGC_MAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZWGC_MAP_SEQUENTIAL  0x1
+#define LZWGC_MAP_HUGEPAGE    0x2
+
+typedef struct
+{
+    unsigned char const * data;   // first byte of the requested range
+    size_t                size;   // bytes in the requested range
+
+    // whole mapping, which starts at an aligned offset at or before data
+    void                * base;
+    size_t                base_size;
+#ifdef _WIN32
+    void                * file;
+    void                * mapping;
+#endif
+} lzwgc_map;
+
+// maps `length` bytes from `offset`, or to end of file if length is 0.
+// a range past the end of file is cut short. False if the file cannot
+// be opened or mapped.
+bool lzwgc_map_open(lzwgc_map*, char const* path, uint64_t offset, uint64_t length, uint32_t flags);
+void lzwgc_map_close(lzwgc_map*);
+
+#define LZWGC_MAP_H
+#endif
@@ -0,0 +1,156 @@
+
+
+#include "lzwgc_pack.h"
+#include <assert.h>
+
+uint32_t lzwgc_token_bits(uint32_t size) {
+    uint32_t bits = 8;
+    while ((1u << bits) < size) { ++bits; }
+    return bits;
+}
+
+size_t lzwgc_pack_bound(size_t count, uint32_t bits) {
+    return ((count * bits + 7) / 8) + 8;
+}
+
+// the next token may refer to any literal or any entry allocated so
+// far; the first two tokens allocate nothing.
+static uint32_t next_width(uint32_t width, uint32_t bits, uint64_t count) {
+    if ((width < bits) && ((count + 254) >= ((uint64_t)1 << width)))
+        return width + 1;
+    return width;
+}
+
+void lzwgc_pack_init(lzwgc_pack* p, uint32_t bits, bool grow, unsigned char* buf, size_t cap) {
+    assert((8 <= bits) && (bits <= 24));
+    assert(cap >= 8);
+    p->acc = 0;
+    p->acc_bits = 0;
+    p->bits = bits;
+    p->width = grow ? 8 : bits;
+    p->grow = grow;
+    p->count = 0;
+    p->data = buf;
+    p->size = 0;
+    p->cap = cap;
+}
+
+size_t lzwgc_pack_tokens(lzwgc_pack* p, token_t const* tok, size_t count) {
+    uint64_t acc = p->acc;
+    uint32_t nb = p->acc_bits;
+    uint32_t width = p->width;
+    uint64_t n = p->count;
+    unsigned char * const buf = p->data;
+    size_t len = p->size;
+    size_t const cap = p->cap;
+    size_t ii = 0;
+
+    while (ii < count) {
+        // flush a whole word before the accumulator could overflow
+        if (nb >= 32) {
+            if ((cap - len) < 4) break;
+            uint32_t const w = (uint32_t)(acc >> 32);
+            buf[len + 0] = (unsigned char)(w >> 24);
+            buf[len + 1] = (unsigned char)(w >> 16);
+            buf[len + 2] = (unsigned char)(w >> 8);
+            buf[len + 3] = (unsigned char)w;
+            len += 4;
+            acc <<= 32;
+            nb -= 32;
+        }
+        if (p->grow) width = next_width(width, p->bits, n);
+        assert(tok[ii] < (1u << width));
+        acc |= (uint64_t)tok[ii] << (64 - nb - width);
+        nb += width;
+        ++n;
+        ++ii;
+    }
+
+    p->acc = acc;
+    p->acc_bits = nb;
+    p->width = width;
+    p->count = n;
+    p->size = len;
+    return ii;
+}
+
+bool lzwgc_pack_flush(lzwgc_pack* p) {
+    if ((p->cap - p->size) < 8)
+        return false;
+    while (p->acc_bits > 0) {
+        p->data[p->size++] = (unsigned char)(p->acc >> 56);
+        p->acc <<= 8;
+        p->acc_bits = (p->acc_bits > 8) ? (p->acc_bits - 8) : 0;
+    }
+    p->acc = 0;
+    return true;
+}
+
+void lzwgc_unpack_init(lzwgc_unpack* u, uint32_t bits, bool grow) {
+    assert((8 <= bits) && (bits <= 24));
+    u->acc = 0;
+    u->acc_bits = 0;
+    u->bits = bits;
+    u->width = grow ? 8 : bits;
+    u->grow = grow;
+    u->count = 0;
+    u->data = 0;
+    u->size = 0;
+    u->pos = 0;
+}
+
+// a new buffer should only be fed once unpacking has used up the last
+void lzwgc_unpack_feed(lzwgc_unpack* u, unsigned char const* buf, size_t size) {
+    assert(u->pos == u->size);
+    u->data = buf;
+    u->size = size;
+    u->pos = 0;
+}
+
+size_t lzwgc_unpack_tokens(lzwgc_unpack* u, token_t* out, size_t cap) {
+    uint64_t acc = u->acc;
+    uint32_t nb = u->acc_bits;
+    uint32_t width = u->width;
+    uint64_t n = u->count;
+    unsigned char const * const buf = u->data;
+    size_t const size = u->size;
+    size_t pos = u->pos;
+    size_t ii = 0;
+
+    while (ii < cap) {
+        uint32_t const w = u->grow ? next_width(width, u->bits, n) : width;
+        if (nb < w) {
+            if ((size - pos) >= 8) {
+                // load a whole word and keep the bytes that fit; bits of
+                // a partial byte are loaded again, unchanged, next time
+                uint64_t const word =
+                    ((uint64_t)buf[pos + 0] << 56) | ((uint64_t)buf[pos + 1] << 48) |
+                    ((uint64_t)buf[pos + 2] << 40) | ((uint64_t)buf[pos + 3] << 32) |
+                    ((uint64_t)buf[pos + 4] << 24) | ((uint64_t)buf[pos + 5] << 16) |
+                    ((uint64_t)buf[pos + 6] << 8) | (uint64_t)buf[pos + 7];
+                uint32_t const k = (63 - nb) >> 3;
+                acc |= word >> nb;
+                pos += k;
+                nb += 8 * k;
+            } else {
+                while ((nb <= 56) && (pos < size)) {
+                    acc |= (uint64_t)buf[pos++] << (56 - nb);
+                    nb += 8;
+                }
+                if (nb < w) break; // wait for more input
+            }
+        }
+        width = w;
+        out[ii++] = (token_t)(acc >> (64 - w));
+        acc <<= w;
+        nb -= w;
+        ++n;
+    }
+
+    u->acc = acc;
+    u->acc_bits = nb;
+    u->width = width;
+    u->count = n;
+    u->pos = pos;
+    return ii;
+}
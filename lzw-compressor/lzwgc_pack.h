@@ -0,0 +1,67 @@
+/*
+* Bit packing for LZW-GC token streams.
+*
+* Tokens are written most significant bit first at a fixed `bits` width,
+* or at a width that grows with the number of dictionary entries that
+* could have been allocated so far. LZW-GC allocates one entry for every
+* token after the first, so both sides can compute the width of the
+* n-th token without looking at the dictionary.
+*
+* Bits collect in a 64-bit accumulator and leave it as whole 32-bit
+* words; only the final flush writes a partial word (padded to a byte).
+* At a fixed width of 16 bits the output is identical to writing each
+* token as two bigendian octets.
+*/
+
+#ifndef LZWGC_PACK_H
+
+#include "lzwgc.h"
+
+typedef struct
+{
+    uint64_t        acc;       // pending bits, most significant first
+    uint32_t        acc_bits;  // number of pending bits
+    uint32_t        bits;      // maximum token width
+    uint32_t        width;     // width of the next token
+    bool            grow;      // width grows with dictionary entries
+    uint64_t        count;     // tokens written so far
+
+    unsigned char * data;      // output buffer (caller owned)
+    size_t          size;      // bytes written to data
+    size_t          cap;       // capacity of data
+} lzwgc_pack;
+
+typedef struct
+{
+    uint64_t              acc;       // pending bits, most significant first
+    uint32_t              acc_bits;  // number of pending bits
+    uint32_t              bits;      // maximum token width
+    uint32_t              width;     // width of the next token
+    bool                  grow;      // width grows with dictionary entries
+    uint64_t              count;     // tokens read so far
+
+    unsigned char const * data;      // input buffer (caller owned)
+    size_t                size;      // bytes available in data
+    size_t                pos;       // bytes consumed from data
+} lzwgc_unpack;
+
+// width of the widest token for a dictionary of `size` (as given to init)
+uint32_t lzwgc_token_bits(uint32_t size);
+
+// upper bound on packed bytes for `count` tokens, including the flush
+size_t lzwgc_pack_bound(size_t count, uint32_t bits);
+
+// packing writes into `buf`. Callers drain it by consuming `size` bytes
+// from `data` and resetting `size` to zero; `cap` must be at least 8.
+void lzwgc_pack_init(lzwgc_pack*, uint32_t bits, bool grow, unsigned char* buf, size_t cap);
+size_t lzwgc_pack_tokens(lzwgc_pack*, token_t const*, size_t count); // returns tokens packed
+bool lzwgc_pack_flush(lzwgc_pack*); // write pending bits; false if buffer lacks 8 bytes
+
+// unpacking reads from buffers handed over by feed. Bits left over from
+// a previous buffer are kept, so a stream may be fed in any pieces.
+void lzwgc_unpack_init(lzwgc_unpack*, uint32_t bits, bool grow);
+void lzwgc_unpack_feed(lzwgc_unpack*, unsigned char const* buf, size_t size);
+size_t lzwgc_unpack_tokens(lzwgc_unpack*, token_t*, size_t cap); // returns tokens read
+
+#define LZWGC_PACK_H
+#endif
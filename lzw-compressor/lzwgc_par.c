@@ -0,0 +1,217 @@
+
+
+#include "lzwgc_par.h"
+#include "lzwgc_thread.h"
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct
+{
+    lzwgc_header            hdr;
+    lzwgc_dict const      * preset;
+    unsigned char const   * in;
+    size_t                  len;
+    size_t                  chunk_size;
+    lzwgc_chunk_state     * states;     // one per worker
+
+    // per chunk results, guarded by lock
+    unsigned char        ** out;
+    lzwgc_chunk_entry     * entries;
+    bool                  * ready;
+    size_t                  delivered;  // chunks handed to the sink
+    size_t                  window;     // chunks allowed past delivered
+    bool                    aborted;
+    lzwgc_mutex             lock;
+    lzwgc_cond              cv;
+} par_compress_job;
+
+static void compress_task(void* ctx, uint32_t worker, size_t ii) {
+    par_compress_job * const job = ctx;
+
+    // tasks are claimed in order, so the chunk being waited on always
+    // falls within the window and this cannot deadlock
+    lzwgc_mutex_lock(&(job->lock));
+    while (!job->aborted && (ii >= (job->delivered + job->window)))
+        lzwgc_cond_wait(&(job->cv), &(job->lock));
+    bool const aborted = job->aborted;
+    lzwgc_mutex_unlock(&(job->lock));
+
+    unsigned char * buf = 0;
+    if (!aborted) {
+        size_t const start = ii * job->chunk_size;
+        size_t const n = ((job->len - start) < job->chunk_size) ? (job->len - start) : job->chunk_size;
+        size_t const cap = lzwgc_chunk_bound(&(job->hdr), n);
+        buf = malloc(cap);
+        assert(0 != buf);
+        lzwgc_chunk_compress_state(&(job->hdr), job->preset, &(job->states[worker]),
+                                   job->in + start, n, buf, cap, &(job->entries[ii]));
+    }
+
+    lzwgc_mutex_lock(&(job->lock));
+    job->out[ii] = buf;
+    job->ready[ii] = true;
+    lzwgc_cond_broadcast(&(job->cv));
+    lzwgc_mutex_unlock(&(job->lock));
+}
+
+void lzwgc_par_defaults(lzwgc_par_opts* opts) {
+    opts->chunk_size = (4 << 20);
+    opts->bits = 16;
+    opts->flags = 0;
+    opts->gc_policy = LZWGC_GC_CLOCK;
+    opts->preset = 0;
+    opts->dict_id = 0;
+}
+
+// workers keep their chunk state from one chunk to the next
+static lzwgc_chunk_state* states_init(lzwgc_pool* pool) {
+    uint32_t const n = lzwgc_pool_size(pool);
+    lzwgc_chunk_state * const states = malloc(n * sizeof(lzwgc_chunk_state));
+    assert(0 != states);
+    for (uint32_t ii = 0; ii < n; ++ii)
+        lzwgc_chunk_state_init(&(states[ii]));
+    return states;
+}
+
+static void states_fini(lzwgc_pool* pool, lzwgc_chunk_state* states) {
+    uint32_t const n = lzwgc_pool_size(pool);
+    for (uint32_t ii = 0; ii < n; ++ii)
+        lzwgc_chunk_state_fini(&(states[ii]));
+    free(states);
+}
+
+bool lzwgc_par_compress(lzwgc_pool* pool, lzwgc_par_opts const* opts, unsigned char const* in, size_t len,
+                        lzwgc_sink_fn sink, void* ctx) {
+    assert(opts->chunk_size > 0);
+    size_t const count = (len + opts->chunk_size - 1) / opts->chunk_size;
+    assert(count <= UINT32_MAX);
+
+    par_compress_job job;
+    lzwgc_header_init(&(job.hdr), opts->bits, opts->flags);
+    job.hdr.gc_policy = opts->gc_policy;
+    job.hdr.dict_id = (0 != opts->preset) ? opts->dict_id : 0;
+    job.preset = opts->preset;
+    job.in = in;
+    job.len = len;
+    job.chunk_size = opts->chunk_size;
+    job.states = states_init(pool);
+    job.out = calloc(count + 1, sizeof(unsigned char*));
+    job.entries = malloc((count + 1) * sizeof(lzwgc_chunk_entry));
+    job.ready = calloc(count + 1, sizeof(bool));
+    assert((0 != job.out) && (0 != job.entries) && (0 != job.ready));
+    job.delivered = 0;
+    job.window = 2 * lzwgc_pool_size(pool);
+    job.aborted = false;
+    lzwgc_mutex_init(&(job.lock));
+    lzwgc_cond_init(&(job.cv));
+
+    unsigned char hbuf[LZWGC_HEADER_SIZE];
+    lzwgc_header_encode(&(job.hdr), hbuf);
+    bool ok = sink(ctx, hbuf, LZWGC_HEADER_SIZE);
+    uint64_t pos = LZWGC_HEADER_SIZE;
+
+    lzwgc_pool_start(pool, ok ? count : 0, compress_task, &job);
+    for (size_t ii = 0; ok && (ii < count); ++ii) {
+        lzwgc_mutex_lock(&(job.lock));
+        while (!job.ready[ii])
+            lzwgc_cond_wait(&(job.cv), &(job.lock));
+        lzwgc_mutex_unlock(&(job.lock));
+
+        job.entries[ii].offset = pos;
+        ok = sink(ctx, job.out[ii], (size_t)job.entries[ii].comp_len);
+        pos += job.entries[ii].comp_len;
+        free(job.out[ii]);
+        job.out[ii] = 0;
+
+        lzwgc_mutex_lock(&(job.lock));
+        job.delivered = ii + 1;
+        job.aborted = !ok;
+        lzwgc_cond_broadcast(&(job.cv));
+        lzwgc_mutex_unlock(&(job.lock));
+    }
+    lzwgc_pool_wait(pool);
+
+    if (ok) {
+        size_t const isz = lzwgc_index_size((uint32_t)count);
+        unsigned char * const ibuf = malloc(isz);
+        assert(0 != ibuf);
+        lzwgc_index_encode(job.entries, (uint32_t)count, pos, ibuf);
+        ok = sink(ctx, ibuf, isz);
+        free(ibuf);
+    }
+
+    // chunks finished after an abort were never delivered
+    for (size_t ii = job.delivered; ii < count; ++ii)
+        free(job.out[ii]);
+
+    lzwgc_cond_fini(&(job.cv));
+    lzwgc_mutex_fini(&(job.lock));
+    states_fini(pool, job.states);
+    free(job.out);
+    free(job.entries);
+    free(job.ready);
+    return ok;
+}
+
+typedef struct
+{
+    lzwgc_header            hdr;
+    lzwgc_dict const      * preset;
+    unsigned char const   * in;
+    unsigned char const   * index;
+    unsigned char         * out;
+    uint64_t              * raw_offset;
+    bool                  * chunk_ok;   // one flag per chunk, no sharing
+    lzwgc_chunk_state     * states;     // one per worker
+} par_decompress_job;
+
+static void decompress_task(void* ctx, uint32_t worker, size_t ii) {
+    par_decompress_job * const job = ctx;
+    lzwgc_chunk_entry e;
+
+    lzwgc_entry_decode(&e, job->index + (ii * LZWGC_ENTRY_SIZE));
+    job->chunk_ok[ii] = lzwgc_chunk_decompress_state(&(job->hdr), job->preset, &(job->states[worker]), &e,
+                                                     job->in + e.offset, job->out + job->raw_offset[ii]);
+}
+
+bool lzwgc_par_decompress(lzwgc_pool* pool, unsigned char const* in, size_t len,
+                          unsigned char* out, size_t cap) {
+    return lzwgc_par_decompress_dict(pool, 0, in, len, out, cap);
+}
+
+bool lzwgc_par_decompress_dict(lzwgc_pool* pool, lzwgc_dict const* preset, unsigned char const* in, size_t len,
+                               unsigned char* out, size_t cap) {
+    par_decompress_job job;
+    lzwgc_trailer tr;
+    if (!lzwgc_container_parse(in, len, &(job.hdr), &tr))
+        return false;
+
+    job.preset = preset;
+    job.in = in;
+    job.index = in + tr.index_offset;
+    job.out = out;
+
+    // chunks are stored in order, so offsets are a prefix sum
+    job.raw_offset = malloc((tr.chunk_count + 1) * sizeof(uint64_t));
+    job.chunk_ok = malloc((tr.chunk_count + 1) * sizeof(bool));
+    assert((0 != job.raw_offset) && (0 != job.chunk_ok));
+    job.raw_offset[0] = 0;
+    for (uint32_t ii = 0; ii < tr.chunk_count; ++ii) {
+        lzwgc_chunk_entry e;
+        lzwgc_entry_decode(&e, job.index + ((size_t)ii * LZWGC_ENTRY_SIZE));
+        job.raw_offset[ii + 1] = job.raw_offset[ii] + e.raw_len;
+    }
+
+    bool ok = (job.raw_offset[tr.chunk_count] <= cap);
+    if (ok) {
+        job.states = states_init(pool);
+        lzwgc_pool_run(pool, tr.chunk_count, decompress_task, &job);
+        states_fini(pool, job.states);
+    }
+    for (uint32_t ii = 0; ok && (ii < tr.chunk_count); ++ii)
+        ok = job.chunk_ok[ii];
+
+    free(job.raw_offset);
+    free(job.chunk_ok);
+    return ok;
+}
@@ -0,0 +1,46 @@
+/*
+* Parallel LZW-GC on a thread pool, no MPI or temporary files.
+*
+* Input is cut into chunks of opts->chunk_size bytes. Each chunk is
+* compressed by a worker with its own dictionary, and the container
+* (header, chunks in order, index) is delivered to a sink in order.
+* At most two chunks per worker are held in memory at once, so a slow
+* sink throttles the workers instead of growing the backlog.
+*
+* Decompression expands the chunks of an in-memory container in
+* parallel, each into its own region of the caller's buffer.
+*/
+
+#ifndef LZWGC_PAR_H
+
+#include "lzwgc_container.h"
+#include "lzwgc_pool.h"
+
+// sink receives consecutive pieces of the output; false aborts
+typedef bool (*lzwgc_sink_fn)(void* ctx, unsigned char const* data, size_t len);
+
+typedef struct
+{
+    size_t          chunk_size;  // uncompressed bytes per chunk
+    uint32_t        bits;        // token width
+    uint32_t        flags;       // LZWGC_FLAG_*
+    uint32_t        gc_policy;   // LZWGC_GC_*
+    lzwgc_dict const * preset;   // starting dictionary for every chunk, or 0
+    uint32_t        dict_id;     // lzwgc_preset_id of preset
+} lzwgc_par_opts;
+
+void lzwgc_par_defaults(lzwgc_par_opts*); // 4MB chunks of 16 bit tokens, clock GC, no preset
+
+// false if the sink aborted
+bool lzwgc_par_compress(lzwgc_pool*, lzwgc_par_opts const*, unsigned char const* in, size_t len,
+                        lzwgc_sink_fn, void* ctx);
+
+// expands a whole container into `out`, which must hold the size given
+// by lzwgc_container_raw_size. False if malformed or corrupt.
+bool lzwgc_par_decompress(lzwgc_pool*, unsigned char const* in, size_t len,
+                          unsigned char* out, size_t cap);
+bool lzwgc_par_decompress_dict(lzwgc_pool*, lzwgc_dict const* preset, unsigned char const* in, size_t len,
+                               unsigned char* out, size_t cap);
+
+#define LZWGC_PAR_H
+#endif
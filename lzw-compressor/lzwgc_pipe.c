@@ -0,0 +1,447 @@
+#include "lzwgc_pipe.h"
+#include "lzwgc_ring.h"
+#include "lzwgc_pack.h"
+#include "lzwgc_entropy.h"
+#include "lzwgc_thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define pipe_batch (1 << 18) // bytes per input batch
+#define pipe_slots 4         // batches in flight between two stages
+#define pipe_block (1 << 16) // bytes per block, each stored or coded on its own merits
+#define pipe_hold  (4 << 20) // input a chunk may lag its coded bytes for before it gives up
+
+// a block as the core hands it to the writer, in one slot: this head,
+// the block's bytes, then the tokens coding them. the tokens end on a
+// token boundary, so a chunk may end with any block. a block that looks
+// incompressible has no tokens.
+typedef struct
+{
+    size_t                  len;       // bytes in the block
+    size_t                  ntok;      // tokens coding them
+    bool                    coded;     // false if it looked incompressible
+} pipe_head;
+
+#define slot_raw  64
+#define slot_tok  (slot_raw + pipe_block)
+#define slot_size (slot_tok + ((pipe_block + 16) * sizeof(token_t))) // a token more than bytes, kept aligned
+
+// the core runs one dictionary over each run of coded blocks, and
+// starts the next run on an empty one (or the preset)
+typedef struct
+{
+    lzwgc_header const    * hdr;
+    lzwgc_dict const      * preset;
+    lzwgc_compress          st;
+    bool                    have_st;   // allocated with the first coded block
+    bool                    run;       // st is coding a run
+} pipe_core;
+
+static void core_init(pipe_core* c, lzwgc_header const* hdr, lzwgc_dict const* preset) {
+    c->hdr = hdr;
+    c->preset = preset;
+    c->have_st = false;
+    c->run = false;
+}
+
+static void core_fini(pipe_core* c) {
+    if (c->have_st) lzwgc_compress_fini(&(c->st));
+}
+
+// core_block fills `slot` for the `len` bytes at `in`, which may be the
+// slot's own bytes
+static void core_block(pipe_core* c, unsigned char const* in, size_t len, unsigned char* slot) {
+    pipe_head * const head = (pipe_head*)slot;
+    token_t * const tok = (token_t*)(slot + slot_tok);
+    assert(sizeof(pipe_head) <= slot_raw);
+    assert((0 < len) && (len <= pipe_block));
+    if (in != (slot + slot_raw)) memcpy(slot + slot_raw, in, len);
+    head->len = len;
+    head->ntok = 0;
+    head->coded = !lzwgc_looks_incompressible(in, len);
+    if (!head->coded) {
+        c->run = false;
+        return;
+    }
+
+    if (!c->have_st) {
+        if (0 != c->preset)
+            lzwgc_compress_init_dict(&(c->st), c->preset);
+        else
+            lzwgc_compress_init_gc(&(c->st), (1 << c->hdr->bits) - 1, c->hdr->gc_policy);
+        c->st.ranked = (0 != (c->hdr->flags & LZWGC_FLAG_ENTROPY));
+        c->have_st = true;
+    } else if (!c->run) {
+        lzwgc_compress_reset(&(c->st), c->preset);
+    }
+    c->run = true;
+
+    size_t used;
+    size_t ntok = lzwgc_compress_block(&(c->st), in, len, tok, pipe_block + 1, &used);
+    assert(used == len);
+    lzwgc_compress_flush(&(c->st));
+    if (c->st.have_output) tok[ntok++] = c->st.token_output;
+    head->ntok = ntok;
+}
+
+// the writer codes each run of blocks as one chunk, but holds its bytes
+// back while they are not yet fewer than the input they code. if that
+// lasts pipe_hold bytes, the chunk ends where it last was ahead, and the
+// held input and the rest of the run are stored. so a chunk never grows.
+#define writer_idle   0 // between runs
+#define writer_coding 1 // a chunk is open
+#define writer_giving 2 // the run gave up; storing to its end
+
+typedef struct
+{
+    lzwgc_header const    * hdr;
+    lzwgc_sink_fn           sink;
+    void                  * sink_ctx;
+    bool                    ok;        // the sink took everything
+    uint64_t                offset;    // bytes handed to it
+
+    lzwgc_chunk_entry     * entries;   // chunks done
+    uint32_t                count;
+    uint32_t                cap;
+    lzwgc_chunk_entry       stored;    // open stored chunk, if raw_len
+    lzwgc_chunk_entry       chunk;     // open coded chunk, as far as written
+
+    uint32_t                mode;      // writer_*
+    bool                    entropy;
+    lzwgc_pack              pk;        // packs into held
+    lzwgc_epack             ep;
+    lzwgc_pack              pk_ahead;  // the packer where the chunk was last ahead
+    lzwgc_emodel            model_ahead;
+    unsigned char         * held;      // coded bytes since
+    size_t                  held_cap;
+    unsigned char         * held_raw;  // input they code
+    size_t                  held_raw_len;
+} pipe_writer;
+
+// after a failed sink the writer keeps going, so the stages before it
+// are never left waiting on a full ring
+static void emit(pipe_writer* w, unsigned char const* data, size_t len) {
+    w->ok = w->ok && w->sink(w->sink_ctx, data, len);
+    w->offset += len;
+}
+
+static void add_entry(pipe_writer* w, lzwgc_chunk_entry const* e) {
+    if (w->count == w->cap) {
+        w->cap = (0 == w->cap) ? 16 : (2 * w->cap);
+        w->entries = realloc(w->entries, w->cap * sizeof(lzwgc_chunk_entry));
+        assert(0 != w->entries);
+    }
+    w->entries[w->count++] = (*e);
+}
+
+static void store(pipe_writer* w, unsigned char const* data, size_t len) {
+    if (0 == w->stored.raw_len) {
+        w->stored.offset = w->offset;
+        w->stored.comp_len = 0;
+        w->stored.checksum = 1;
+        w->stored.type = LZWGC_CHUNK_STORED;
+    }
+    emit(w, data, len);
+    w->stored.raw_len += len;
+    w->stored.comp_len += len;
+    w->stored.checksum = lzwgc_adler32(w->stored.checksum, data, len);
+}
+
+static void end_stored(pipe_writer* w) {
+    if (0 != w->stored.raw_len) add_entry(w, &(w->stored));
+    w->stored.raw_len = 0;
+}
+
+// the packer's bytes so far
+static size_t* held_len(pipe_writer* w) {
+    return w->entropy ? &(w->ep.size) : &(w->pk.size);
+}
+
+// room for `more` past them
+static void hold_room(pipe_writer* w, size_t more) {
+    size_t const need = (*held_len(w)) + more;
+    if (need <= w->held_cap)
+        return;
+    while (w->held_cap < need) w->held_cap *= 2;
+    w->held = realloc(w->held, w->held_cap);
+    assert(0 != w->held);
+    w->pk.data = w->held;
+    w->pk.cap = w->held_cap;
+    w->ep.data = w->held;
+    w->ep.cap = w->held_cap;
+}
+
+static void open_chunk(pipe_writer* w) {
+    lzwgc_header const * const hdr = w->hdr;
+    end_stored(w);
+    w->chunk.offset = w->offset;
+    w->chunk.comp_len = 0;
+    w->chunk.raw_len = 0;
+    w->chunk.checksum = 1;
+    w->chunk.type = LZWGC_CHUNK_TOKENS;
+    if (w->entropy) {
+        lzwgc_epack_init(&(w->ep), hdr->bits, w->held, w->held_cap);
+        w->model_ahead = w->ep.model;
+    } else {
+        lzwgc_pack_init(&(w->pk), hdr->bits, (0 != (hdr->flags & LZWGC_FLAG_GROW)), w->held, w->held_cap);
+        w->pk_ahead = w->pk;
+    }
+    w->held_raw_len = 0;
+    w->mode = writer_coding;
+}
+
+// the held bytes join the chunk, which is ahead here
+static void commit(pipe_writer* w) {
+    size_t * const len = held_len(w);
+    emit(w, w->held, *len);
+    w->chunk.comp_len += (*len);
+    w->chunk.raw_len += w->held_raw_len;
+    w->chunk.checksum = lzwgc_adler32(w->chunk.checksum, w->held_raw, w->held_raw_len);
+    (*len) = 0;
+    w->held_raw_len = 0;
+    if (w->entropy) w->model_ahead = w->ep.model;
+    else w->pk_ahead = w->pk;
+}
+
+// close_chunk ends the open chunk with everything held, if that leaves
+// it smaller than its input, else where it was last ahead, storing the
+// rest. packers end on a frame at every block, so the epack has nothing
+// pending to flush, and the pack at most 8 bytes.
+static void close_chunk(pipe_writer* w) {
+    hold_room(w, 8);
+    if (!w->entropy) lzwgc_pack_flush(&(w->pk));
+    if ((w->chunk.comp_len + (*held_len(w))) < (w->chunk.raw_len + w->held_raw_len)) {
+        commit(w);
+    } else {
+        if (w->entropy) {
+            w->ep.model = w->model_ahead;
+            w->ep.size = 0;
+        } else {
+            w->pk = w->pk_ahead;
+            w->pk.data = w->held;
+            w->pk.cap = w->held_cap;
+            lzwgc_pack_flush(&(w->pk));
+        }
+        emit(w, w->held, *held_len(w));
+        w->chunk.comp_len += (*held_len(w));
+        (*held_len(w)) = 0;
+    }
+    if (w->entropy) lzwgc_epack_fini(&(w->ep));
+    if (0 != w->chunk.raw_len) add_entry(w, &(w->chunk));
+    if (0 != w->held_raw_len) store(w, w->held_raw, w->held_raw_len);
+    w->held_raw_len = 0;
+    w->mode = writer_idle;
+}
+
+static void writer_init(pipe_writer* w, lzwgc_header const* hdr, lzwgc_sink_fn sink, void* sink_ctx) {
+    unsigned char head[LZWGC_HEADER_SIZE];
+    w->hdr = hdr;
+    w->sink = sink;
+    w->sink_ctx = sink_ctx;
+    w->ok = true;
+    w->offset = 0;
+    w->entries = 0;
+    w->count = 0;
+    w->cap = 0;
+    w->stored.raw_len = 0;
+    w->mode = writer_idle;
+    w->entropy = (0 != (hdr->flags & LZWGC_FLAG_ENTROPY));
+    w->held_cap = w->entropy ? lzwgc_epack_bound(pipe_block + 1, hdr->bits)
+                             : lzwgc_pack_bound(pipe_block + 1, hdr->bits);
+    w->held = malloc(w->held_cap);
+    w->held_raw = malloc(pipe_hold + pipe_block);
+    w->held_raw_len = 0;
+    assert((0 != w->held) && (0 != w->held_raw));
+
+    lzwgc_header_encode(hdr, head);
+    emit(w, head, LZWGC_HEADER_SIZE);
+}
+
+static void writer_block(pipe_writer* w, unsigned char const* slot) {
+    pipe_head const * const head = (pipe_head const*)slot;
+    unsigned char const * const raw = slot + slot_raw;
+    token_t const * const tok = (token_t const*)(slot + slot_tok);
+
+    if (!head->coded) {
+        if (writer_coding == w->mode) close_chunk(w);
+        w->mode = writer_idle;
+        store(w, raw, head->len);
+        return;
+    }
+    if (writer_giving == w->mode) {
+        store(w, raw, head->len);
+        return;
+    }
+    if (writer_idle == w->mode) open_chunk(w);
+
+    if (w->entropy) {
+        hold_room(w, lzwgc_epack_bound(head->ntok, w->hdr->bits));
+        lzwgc_epack_tokens(&(w->ep), tok, head->ntok);
+        lzwgc_epack_flush(&(w->ep));
+    } else {
+        hold_room(w, lzwgc_pack_bound(head->ntok, w->hdr->bits));
+        lzwgc_pack_tokens(&(w->pk), tok, head->ntok);
+    }
+    memcpy(w->held_raw + w->held_raw_len, raw, head->len);
+    w->held_raw_len += head->len;
+
+    // up to 8 more bytes would end the chunk here
+    if ((w->chunk.comp_len + (*held_len(w)) + 8) < (w->chunk.raw_len + w->held_raw_len)) {
+        commit(w);
+    } else if (w->held_raw_len >= pipe_hold) {
+        close_chunk(w);
+        w->mode = writer_giving;
+    }
+}
+
+// writer_finish ends the last chunk and writes the index
+static bool writer_finish(pipe_writer* w) {
+    if (writer_coding == w->mode) close_chunk(w);
+    end_stored(w);
+
+    size_t const len = lzwgc_index_size(w->count);
+    unsigned char * const idx = malloc(len);
+    assert(0 != idx);
+    lzwgc_index_encode(w->entries, w->count, w->offset, idx);
+    emit(w, idx, len);
+    free(idx);
+
+    free(w->entries);
+    free(w->held);
+    free(w->held_raw);
+    return w->ok;
+}
+
+typedef struct
+{
+    lzwgc_source_fn         src;
+    void                  * src_ctx;
+    lzwgc_ring              raw;       // reader -> core
+    lzwgc_ring              tok;       // core -> writer, a block per slot
+    pipe_writer             writer;
+} pipe_job;
+
+static void reader_main(void* arg) {
+    pipe_job * const job = arg;
+    size_t len;
+    do {
+        unsigned char * const buf = lzwgc_ring_claim(&(job->raw));
+        len = job->src(job->src_ctx, buf, pipe_batch);
+        if (0 != len) lzwgc_ring_push(&(job->raw), len);
+    } while (0 != len);
+    lzwgc_ring_close(&(job->raw));
+}
+
+static void writer_main(void* arg) {
+    pipe_job * const job = arg;
+    unsigned char const * slot;
+    size_t len;
+    while (0 != (slot = lzwgc_ring_peek(&(job->tok), &len))) {
+        writer_block(&(job->writer), slot);
+        lzwgc_ring_pop(&(job->tok));
+    }
+}
+
+static void core_send(pipe_job* job, pipe_core* c, unsigned char const* in, size_t len) {
+    core_block(c, in, len, lzwgc_ring_claim(&(job->tok)));
+    lzwgc_ring_push(&(job->tok), slot_size);
+}
+
+// the LZW core, on the calling thread. blocks lie at fixed offsets in
+// the stream, as the serial writer reads them, whatever the batches; one
+// cut by the end of a batch is gathered first.
+static void compress_main(pipe_job* job, pipe_core* c) {
+    unsigned char * const part = malloc(pipe_block);
+    size_t part_len = 0;
+    unsigned char const * in;
+    size_t len;
+    assert(0 != part);
+
+    while (0 != (in = lzwgc_ring_peek(&(job->raw), &len))) {
+        size_t pos = 0;
+        while (pos < len) {
+            size_t const n = ((len - pos) < (pipe_block - part_len)) ? (len - pos) : (pipe_block - part_len);
+            if ((0 == part_len) && (pipe_block == n)) {
+                core_send(job, c, in + pos, n);
+            } else {
+                memcpy(part + part_len, in + pos, n);
+                part_len += n;
+                if (pipe_block == part_len) {
+                    core_send(job, c, part, part_len);
+                    part_len = 0;
+                }
+            }
+            pos += n;
+        }
+        lzwgc_ring_pop(&(job->raw));
+    }
+    if (0 != part_len) core_send(job, c, part, part_len);
+    lzwgc_ring_close(&(job->tok));
+    free(part);
+}
+
+bool lzwgc_pipe_compress(lzwgc_header const* hdr, lzwgc_dict const* preset,
+                         lzwgc_source_fn src, void* src_ctx, lzwgc_sink_fn sink, void* sink_ctx) {
+    pipe_job job;
+    pipe_core core;
+    lzwgc_thread reader, writer;
+
+    job.src = src;
+    job.src_ctx = src_ctx;
+    lzwgc_ring_init(&(job.raw), pipe_slots, pipe_batch);
+    lzwgc_ring_init(&(job.tok), pipe_slots, slot_size);
+    writer_init(&(job.writer), hdr, sink, sink_ctx);
+    core_init(&core, hdr, preset);
+
+    bool started = lzwgc_thread_start(&writer, writer_main, &job);
+    if (started) {
+        // without a reader the stream is cut short, but the writer still
+        // needs its rings closed to finish
+        started = lzwgc_thread_start(&reader, reader_main, &job);
+        if (!started) lzwgc_ring_close(&(job.raw));
+        compress_main(&job, &core);
+        if (started) lzwgc_thread_join(&reader);
+        lzwgc_thread_join(&writer);
+    }
+
+    // the index only follows a whole stream
+    if (!started) job.writer.ok = false;
+    bool const ok = writer_finish(&(job.writer));
+    core_fini(&core);
+    lzwgc_ring_fini(&(job.raw));
+    lzwgc_ring_fini(&(job.tok));
+    return ok;
+}
+
+// up to `cap` bytes, short only where the source ends
+static size_t fill(lzwgc_source_fn src, void* ctx, unsigned char* buf, size_t cap, bool* end) {
+    size_t len = 0;
+    while ((len < cap) && !(*end)) {
+        size_t const n = src(ctx, buf + len, cap - len);
+        (*end) = (0 == n);
+        len += n;
+    }
+    return len;
+}
+
+bool lzwgc_stream_compress(lzwgc_header const* hdr, lzwgc_dict const* preset,
+                           lzwgc_source_fn src, void* src_ctx, lzwgc_sink_fn sink, void* sink_ctx) {
+    unsigned char * const slot = malloc(slot_size);
+    pipe_core core;
+    pipe_writer writer;
+    bool end = false;
+    size_t len;
+    assert(0 != slot);
+
+    writer_init(&writer, hdr, sink, sink_ctx);
+    core_init(&core, hdr, preset);
+    while (0 != (len = fill(src, src_ctx, slot + slot_raw, pipe_block, &end))) {
+        core_block(&core, slot + slot_raw, len, slot);
+        writer_block(&writer, slot);
+    }
+    bool const ok = writer_finish(&writer);
+    core_fini(&core);
+    free(slot);
+    return ok;
+}
@@ -0,0 +1,39 @@
+/*
+* Pipelined LZW-GC for a stream that should stay few chunks.
+*
+* Chunking (lzwgc_par) costs ratio, since every chunk starts with an
+* empty dictionary. Here the stream is compressed by one dictionary as
+* lzwgc does serially, but reading, the dictionary work and packing and
+* writing run on three threads joined by lzwgc_ring buffers:
+*
+*   reader      source -> input batches
+*   caller      input batches -> 64KB blocks and their tokens (the LZW core)
+*   writer      tokens -> packed or entropy coded bytes -> sink
+*
+* So the dictionary thread never waits on I/O, and a large stream goes
+* about as fast as the core loop. The output is byte for byte what
+* lzwgc_stream_compress writes on one thread. Each 64KB block is judged
+* on its own: one that looks incompressible is stored, and a run of the
+* others is coded by one dictionary as one chunk, so long as that chunk
+* keeps smaller than its input. A run that falls behind for 4MB ends
+* where it was last ahead, and the rest of it is stored. So the output
+* is never more than the input plus the header, index and trailer.
+*/
+
+#ifndef LZWGC_PIPE_H
+
+#include "lzwgc_par.h"
+
+// source fills up to `cap` bytes of `buf`, returning how many; 0 ends the stream
+typedef size_t (*lzwgc_source_fn)(void* ctx, unsigned char* buf, size_t cap);
+
+// false if the sink aborted or a thread could not be started
+bool lzwgc_pipe_compress(lzwgc_header const*, lzwgc_dict const* preset,
+                         lzwgc_source_fn, void* src_ctx, lzwgc_sink_fn, void* sink_ctx);
+
+// the same container, on the calling thread; false if the sink aborted
+bool lzwgc_stream_compress(lzwgc_header const*, lzwgc_dict const* preset,
+                           lzwgc_source_fn, void* src_ctx, lzwgc_sink_fn, void* sink_ctx);
+
+#define LZWGC_PIPE_H
+#endif
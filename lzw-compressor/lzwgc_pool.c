@@ -0,0 +1,132 @@
+
+
+#include "lzwgc_pool.h"
+#include "lzwgc_thread.h"
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct
+{
+    lzwgc_pool    * pool;
+    uint32_t        id;
+    lzwgc_thread    thread;
+} lzwgc_worker;
+
+struct lzwgc_pool
+{
+    lzwgc_mutex     lock;
+    lzwgc_cond      wake;      // signalled when a batch starts or on quit
+    lzwgc_cond      done;      // signalled when a batch completes
+    uint32_t        size;
+    lzwgc_worker  * workers;
+
+    // current batch, guarded by lock
+    lzwgc_task_fn   fn;
+    void          * ctx;
+    size_t          count;     // tasks in batch
+    size_t          next;      // next task to claim
+    size_t          finished;  // tasks returned
+    bool            quit;
+};
+
+static void worker_main(void* arg) {
+    lzwgc_worker * const w = arg;
+    lzwgc_pool * const pool = w->pool;
+
+    lzwgc_mutex_lock(&(pool->lock));
+    while (1) {
+        while (!pool->quit && (pool->next >= pool->count))
+            lzwgc_cond_wait(&(pool->wake), &(pool->lock));
+        if (pool->quit)
+            break;
+
+        size_t const task = pool->next++;
+        lzwgc_task_fn const fn = pool->fn;
+        void * const ctx = pool->ctx;
+        lzwgc_mutex_unlock(&(pool->lock));
+
+        fn(ctx, w->id, task);
+
+        lzwgc_mutex_lock(&(pool->lock));
+        pool->finished += 1;
+        if (pool->finished == pool->count)
+            lzwgc_cond_broadcast(&(pool->done));
+    }
+    lzwgc_mutex_unlock(&(pool->lock));
+}
+
+lzwgc_pool* lzwgc_pool_create(uint32_t threads) {
+    if (0 == threads)
+        threads = lzwgc_cpu_count();
+
+    lzwgc_pool * const pool = malloc(sizeof(lzwgc_pool));
+    assert(0 != pool);
+    pool->workers = malloc(threads * sizeof(lzwgc_worker));
+    assert(0 != pool->workers);
+
+    lzwgc_mutex_init(&(pool->lock));
+    lzwgc_cond_init(&(pool->wake));
+    lzwgc_cond_init(&(pool->done));
+    pool->fn = 0;
+    pool->ctx = 0;
+    pool->count = 0;
+    pool->next = 0;
+    pool->finished = 0;
+    pool->quit = false;
+
+    // run with however many threads we manage to start
+    pool->size = 0;
+    for (uint32_t ii = 0; ii < threads; ++ii) {
+        lzwgc_worker * const w = &(pool->workers[pool->size]);
+        w->pool = pool;
+        w->id = pool->size;
+        if (lzwgc_thread_start(&(w->thread), worker_main, w))
+            pool->size += 1;
+    }
+    assert(pool->size > 0);
+    return pool;
+}
+
+uint32_t lzwgc_pool_size(lzwgc_pool const* pool) {
+    return pool->size;
+}
+
+void lzwgc_pool_start(lzwgc_pool* pool, size_t count, lzwgc_task_fn fn, void* ctx) {
+    lzwgc_mutex_lock(&(pool->lock));
+    assert(pool->finished == pool->count); // one batch at a time
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->next = 0;
+    pool->finished = 0;
+    lzwgc_cond_broadcast(&(pool->wake));
+    lzwgc_mutex_unlock(&(pool->lock));
+}
+
+void lzwgc_pool_wait(lzwgc_pool* pool) {
+    lzwgc_mutex_lock(&(pool->lock));
+    while (pool->finished < pool->count)
+        lzwgc_cond_wait(&(pool->done), &(pool->lock));
+    lzwgc_mutex_unlock(&(pool->lock));
+}
+
+void lzwgc_pool_run(lzwgc_pool* pool, size_t count, lzwgc_task_fn fn, void* ctx) {
+    lzwgc_pool_start(pool, count, fn, ctx);
+    lzwgc_pool_wait(pool);
+}
+
+void lzwgc_pool_destroy(lzwgc_pool* pool) {
+    lzwgc_mutex_lock(&(pool->lock));
+    pool->quit = true;
+    lzwgc_cond_broadcast(&(pool->wake));
+    lzwgc_mutex_unlock(&(pool->lock));
+
+    for (uint32_t ii = 0; ii < pool->size; ++ii)
+        lzwgc_thread_join(&(pool->workers[ii].thread));
+
+    lzwgc_cond_fini(&(pool->done));
+    lzwgc_cond_fini(&(pool->wake));
+    lzwgc_mutex_fini(&(pool->lock));
+    free(pool->workers);
+    free(pool);
+}
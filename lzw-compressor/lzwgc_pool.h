@@ -0,0 +1,31 @@
+/*
+* A fixed set of worker threads that run batches of independent tasks.
+*
+* A batch is `count` calls of fn(ctx, worker, task) for task 0 .. count-1.
+* Workers claim the next unclaimed task whenever they finish one, so
+* slow tasks do not hold up the rest, and tasks are claimed in order.
+* The worker index (0 .. size-1) lets tasks keep per-worker state.
+*
+* One batch runs at a time. lzwgc_pool_start returns at once so the
+* caller can consume results while workers run; lzwgc_pool_wait blocks
+* until every task of the batch has returned.
+*/
+
+#ifndef LZWGC_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct lzwgc_pool lzwgc_pool;
+typedef void (*lzwgc_task_fn)(void* ctx, uint32_t worker, size_t task);
+
+lzwgc_pool* lzwgc_pool_create(uint32_t threads); // 0 for one per processor
+uint32_t lzwgc_pool_size(lzwgc_pool const*);
+void lzwgc_pool_start(lzwgc_pool*, size_t count, lzwgc_task_fn, void* ctx);
+void lzwgc_pool_wait(lzwgc_pool*);
+void lzwgc_pool_run(lzwgc_pool*, size_t count, lzwgc_task_fn, void* ctx); // start + wait
+void lzwgc_pool_destroy(lzwgc_pool*);
+
+#define LZWGC_POOL_H
+#endif
@@ -0,0 +1,158 @@
+
+
+#include "lzwgc_preset.h"
+#include "lzwgc_container.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define preset_header 16
+
+static void put32(unsigned char* b, uint32_t v) {
+    b[0] = (unsigned char)v; b[1] = (unsigned char)(v >> 8);
+    b[2] = (unsigned char)(v >> 16); b[3] = (unsigned char)(v >> 24);
+}
+static uint32_t get32(unsigned char const* b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) |
+        ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static size_t image_size(uint32_t size, uint32_t gc_policy) {
+    size_t const n = size - 256;
+    size_t bytes = preset_header + (n * 9);
+    if (LZWGC_GC_CLOCK != gc_policy) bytes += n;
+    if (LZWGC_GC_LRU == gc_policy) bytes += (n + 1) * 4;
+    return bytes;
+}
+
+// same steps as lzwgc_compress_block without anywhere to put tokens
+void lzwgc_dict_train(lzwgc_dict* dict, unsigned char const* sample, size_t len) {
+    token_t const size = dict->size;
+    token_t s = size;
+    for (size_t ii = 0; ii < len; ++ii) {
+        unsigned char const c = sample[ii];
+        token_t token_found;
+        if (lzwgc_dict_lookup(dict, s, c, &token_found)) {
+            s = token_found;
+            continue;
+        }
+        if (s < size)
+            lzwgc_dict_update(dict, s);
+        s = (token_t)c;
+    }
+    if (s < size)
+        lzwgc_dict_update(dict, s);
+    dict->hist_token = size; // the next sample is unrelated
+}
+
+size_t lzwgc_preset_size(lzwgc_dict const* dict) {
+    return image_size(dict->size, dict->gc_policy);
+}
+
+void lzwgc_preset_save(lzwgc_dict const* dict, unsigned char* b) {
+    uint32_t const n = dict->size - 256;
+
+    memcpy(b, "LZWD", 4);
+    b[4] = (unsigned char)LZWGC_PRESET_VERSION;
+    b[5] = (unsigned char)(LZWGC_PRESET_VERSION >> 8);
+    b[6] = (unsigned char)dict->gc_policy;
+    b[7] = 0; // reserved
+    put32(b + 8, dict->size);
+    put32(b + 12, dict->alloc_idx);
+    b += preset_header;
+
+    for (uint32_t ii = 0; ii < n; ++ii, b += 4) put32(b, lzwgc_dict_prev(dict, ii));
+    for (uint32_t ii = 0; ii < n; ++ii, b += 4) put32(b, lzwgc_dict_count(dict, ii));
+    memcpy(b, dict->added_char, n);
+    b += n;
+    if (LZWGC_GC_CLOCK != dict->gc_policy) {
+        memcpy(b, dict->first_char, n);
+        b += n;
+    }
+    if (LZWGC_GC_LRU == dict->gc_policy) {
+        for (uint32_t ii = 0; ii <= n; ++ii, b += 4) put32(b, lzwgc_dict_lru_next(dict, ii));
+    }
+}
+
+bool lzwgc_preset_load(lzwgc_dict* dict, unsigned char const* b, size_t len) {
+    if ((len < preset_header) || (0 != memcmp(b, "LZWD", 4))) return false;
+    uint32_t const version = (uint32_t)b[4] | ((uint32_t)b[5] << 8);
+    uint32_t const gc_policy = b[6];
+    uint32_t const size = get32(b + 8);
+    uint32_t const alloc_idx = get32(b + 12);
+    if ((LZWGC_PRESET_VERSION != version) || (gc_policy >= LZWGC_GC_COUNT)) return false;
+    if ((size <= (1 << 8)) || (size > (1 << 24))) return false;
+    if ((len != image_size(size, gc_policy)) || (alloc_idx >= (size - 256))) return false;
+
+    uint32_t const n = size - 256;
+    unsigned char const * const prev = b + preset_header;
+    unsigned char const * const count = prev + ((size_t)n * 4);
+    unsigned char const * const added = count + ((size_t)n * 4);
+    unsigned char const * const first = added + n;
+    unsigned char const * const next = first + n;
+
+    for (uint32_t ii = 0; ii < n; ++ii) {
+        if (get32(prev + ((size_t)ii * 4)) >= size) return false;
+    }
+
+    // the clock policy credits a whole chain, so every string must lead
+    // back to a literal; one that loops or runs into an unused entry
+    // would never end. lazy and lru orphan strings, so their chains may
+    // loop, and are only ever walked a bounded number of steps.
+    // walk[ix] is the walk that first reached ix, plus one; reaching an
+    // entry an earlier walk passed means the rest is known to be good.
+    uint32_t * const walk = calloc(n, sizeof(uint32_t));
+    assert(0 != walk);
+    bool ok = true;
+    for (uint32_t ii = 0; ok && (LZWGC_GC_CLOCK == gc_policy) && (ii < n); ++ii) {
+        uint32_t tok = ii + 256;
+        if (get32(prev + ((size_t)ii * 4)) == tok) continue; // unused
+        while (ok && (tok >= 256) && (0 == walk[tok - 256])) {
+            walk[tok - 256] = ii + 1;
+            tok = get32(prev + ((size_t)(tok - 256) * 4));
+            ok = (tok < 256) ||
+                ((get32(prev + ((size_t)(tok - 256) * 4)) != tok) && (walk[tok - 256] != (ii + 1)));
+        }
+    }
+    free(walk);
+    if (!ok) return false;
+
+    // counts that do not fit the dictionary's width cannot come from one
+    lzwgc_dict_init_gc(dict, size, gc_policy);
+    for (uint32_t ii = 0; ii < n; ++ii) {
+        lzwgc_dict_set_prev(dict, ii, get32(prev + ((size_t)ii * 4)));
+        if (!lzwgc_dict_set_count(dict, ii, get32(count + ((size_t)ii * 4)))) {
+            lzwgc_dict_fini(dict);
+            return false;
+        }
+    }
+    memcpy(dict->added_char, added, n);
+    if (LZWGC_GC_CLOCK != gc_policy)
+        memcpy(dict->first_char, first, n);
+    dict->alloc_idx = alloc_idx;
+
+    if (LZWGC_GC_LRU == gc_policy) {
+        // rebuild the back links, and check the list visits every entry
+        // exactly once before returning to the head
+        uint32_t ix = n;
+        for (uint32_t ii = 0; ok && (ii <= n); ++ii) {
+            uint32_t const nx = get32(next + ((size_t)ix * 4));
+            ok = (nx <= n) && (nx != ix);
+            if (ok) {
+                lzwgc_dict_set_lru_next(dict, ix, nx);
+                ix = nx;
+            }
+            ok = ok && ((nx == n) == (ii == n));
+        }
+        if (!ok) {
+            lzwgc_dict_fini(dict);
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t lzwgc_preset_id(unsigned char const* buf, size_t len) {
+    uint32_t const id = lzwgc_adler32(1, buf, len);
+    return (0 != id) ? id : 1;
+}
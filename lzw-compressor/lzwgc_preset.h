@@ -0,0 +1,44 @@
+/*
+* Preset dictionaries for LZW-GC.
+*
+* Every stream normally starts from an empty dictionary, so small
+* chunks compress poorly. A preset is a dictionary trained on sample
+* data ahead of time; compressor and decompressor both start from a
+* copy of it (lzwgc_compress_init_dict, lzwgc_decompress_init_dict).
+*
+* Presets are saved as a flat little endian image of the dictionary:
+*
+*   "LZWD", format version (u16), GC policy (u8), reserved (u8),
+*   size (u32), alloc_idx (u32), then per entry arrays of prev_token
+*   (u32), match_count (u32) and added_char (u8), followed by
+*   first_char (u8, lazy and lru GC) and the recency list (u32 per
+*   entry plus the head, lru GC).
+*
+* A preset is identified by the Adler-32 of its saved image, which the
+* container records so a stream cannot be decoded with the wrong one.
+*/
+
+#ifndef LZWGC_PRESET_H
+
+#include "lzwgc.h"
+
+#define LZWGC_PRESET_VERSION 1
+
+// train runs sample data through the dictionary as a compressor would,
+// discarding the tokens. It may be called once per sample; each starts
+// a new match but keeps all entries learned so far.
+void lzwgc_dict_train(lzwgc_dict*, unsigned char const* sample, size_t len);
+
+// save writes lzwgc_preset_size bytes to `buf`
+size_t lzwgc_preset_size(lzwgc_dict const*);
+void lzwgc_preset_save(lzwgc_dict const*, unsigned char* buf);
+
+// load initializes the dictionary from a saved image. False, with the
+// dictionary left uninitialized, if the image is malformed.
+bool lzwgc_preset_load(lzwgc_dict*, unsigned char const* buf, size_t len);
+
+// id of a saved image; never 0, which means no preset
+uint32_t lzwgc_preset_id(unsigned char const* buf, size_t len);
+
+#define LZWGC_PRESET_H
+#endif
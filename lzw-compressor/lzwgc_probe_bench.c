@@ -0,0 +1,121 @@
+#include "lzwgc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define queries  (1 << 22)
+#define bits_min 9
+#define bits_max 24
+
+// xorshift64, so every probe sees the same dictionary and queries
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+// fill sets every entry to extend some earlier token by a random byte,
+// as a dictionary long in use would be; the hashtable is built from
+// these on the first lookup.
+static void fill(lzwgc_dict* dict, uint64_t seed) {
+    uint32_t const n = dict->size - 256;
+    for (uint32_t ii = 0; ii < n; ++ii) {
+        lzwgc_dict_set_prev(dict, ii, (token_t)(rnd(&seed) % (256 + ii)));
+        dict->added_char[ii] = (unsigned char)rnd(&seed);
+    }
+    dict->alloc_idx = n - 1;
+}
+
+// lookups per second over the query strings s[i] + c[i], best of reps
+static double rate(lzwgc_dict* dict, token_t const* s, unsigned char const* c, uint32_t reps, uint32_t* found) {
+    double best = 0;
+    (*found) = 0;
+    for (uint32_t r = 0; r < reps; ++r) {
+        token_t tok;
+        uint32_t hits = 0;
+        clock_t const t0 = clock();
+        for (uint32_t ii = 0; ii < queries; ++ii)
+            hits += lzwgc_dict_lookup(dict, s[ii], c[ii], &tok);
+        double const secs = (double)(clock() - t0) / CLOCKS_PER_SEC;
+        double const per_sec = (secs > 0) ? queries / secs : 0;
+        if (per_sec > best) best = per_sec;
+        (*found) = hits;
+    }
+    return best;
+}
+
+/** LZW-GC hashtable probing microbenchmark:
+ *  lzwgc_probe_bench [-r reps] [bits ...]
+ *  For each dictionary width (default 16 and 24, i.e. 2^16 and 2^24
+ *  entries) a full dictionary of random strings is looked up 4M times:
+ *  once for strings it holds, as when compression extends a match, and
+ *  once for random strings, nearly all absent, as when a token is
+ *  emitted. Reported in millions of lookups per second, best of reps
+ *  (default 3).
+ */
+int main(int argc, char * argv[]) {
+    uint32_t reps = 3;
+    uint32_t widths[bits_max + 1];
+    uint32_t nwidths = 0;
+    int i = 1;
+
+    if ((i + 1 < argc) && (0 == strcmp(argv[i], "-r"))) {
+        reps = atoi(argv[i + 1]);
+        i += 2;
+    }
+    for (; i < argc; ++i) {
+        uint32_t const b = atoi(argv[i]);
+        if ((b < bits_min) || (b > bits_max) || (nwidths > bits_max) || (0 == reps)) {
+            printf("ERROR: Token width must be %d to %d bits.", bits_min, bits_max);
+            return -1;
+        }
+        widths[nwidths++] = b;
+    }
+    if (0 == nwidths) {
+        widths[nwidths++] = 16;
+        widths[nwidths++] = 24;
+    }
+
+    token_t * const s = malloc(queries * sizeof(token_t));
+    unsigned char * const c = malloc(queries);
+    if ((0 == s) || (0 == c)) {
+        printf("ERROR: Out of memory.");
+        return -1;
+    }
+    printf("bits  hit Mlookup/s  miss Mlookup/s\n");
+
+    for (uint32_t w = 0; w < nwidths; ++w) {
+        uint32_t const size = (1u << widths[w]) - 1;
+        lzwgc_dict dict;
+        uint32_t found_hit, found_miss;
+        uint64_t seed = 0x9e3779b97f4a7c15ull;
+
+        lzwgc_dict_init(&dict, size);
+        fill(&dict, seed);
+
+        // strings the dictionary holds, in random order
+        for (uint32_t ii = 0; ii < queries; ++ii) {
+            uint32_t const ix = (uint32_t)(rnd(&seed) % (size - 256));
+            s[ii] = lzwgc_dict_prev(&dict, ix);
+            c[ii] = dict.added_char[ix];
+        }
+        double const hit = rate(&dict, s, c, reps, &found_hit);
+
+        // random strings
+        for (uint32_t ii = 0; ii < queries; ++ii) {
+            s[ii] = (token_t)(rnd(&seed) % size);
+            c[ii] = (unsigned char)rnd(&seed);
+        }
+        double const miss = rate(&dict, s, c, reps, &found_miss);
+
+        printf("%4u  %13.1f  %14.1f\n", widths[w], hit / 1e6, miss / 1e6);
+        if (found_hit != queries) printf("ERROR: %u of %u strings not found.\n", queries - found_hit, queries);
+        lzwgc_dict_fini(&dict);
+    }
+
+    free(s);
+    free(c);
+    return 0;
+}
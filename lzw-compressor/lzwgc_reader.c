@@ -0,0 +1,188 @@
+
+
+#include "lzwgc_reader.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct
+{
+    uint32_t        chunk;
+    unsigned char * dest;        // raw_len bytes
+    bool            ok;
+} read_task;
+
+typedef struct
+{
+    lzwgc_reader  * r;
+    read_task     * tasks;
+} read_job;
+
+static void read_chunk(void* ctx, uint32_t worker, size_t ii) {
+    read_job * const job = ctx;
+    lzwgc_reader * const r = job->r;
+    read_task * const t = job->tasks + ii;
+    lzwgc_chunk_entry e;
+
+    lzwgc_entry_decode(&e, r->index + ((size_t)t->chunk * LZWGC_ENTRY_SIZE));
+    t->ok = lzwgc_chunk_decompress_state(&(r->hdr), r->preset, &(r->states[worker]), &e,
+                                         r->in + e.offset, t->dest);
+}
+
+bool lzwgc_reader_init(lzwgc_reader* r, lzwgc_pool* pool, lzwgc_dict const* preset,
+                       unsigned char const* in, size_t len, uint32_t cache_chunks) {
+    lzwgc_trailer tr;
+    if (!lzwgc_container_parse(in, len, &(r->hdr), &tr) || ((0 == r->hdr.dict_id) != (0 == preset)))
+        return false;
+
+    r->preset = preset;
+    r->in = in;
+    r->index = in + tr.index_offset;
+    r->chunk_count = tr.chunk_count;
+    r->raw_offset = malloc((tr.chunk_count + 1) * sizeof(uint64_t));
+    assert(0 != r->raw_offset);
+    r->raw_offset[0] = 0;
+    for (uint32_t ii = 0; ii < tr.chunk_count; ++ii) {
+        lzwgc_chunk_entry e;
+        lzwgc_entry_decode(&e, r->index + ((size_t)ii * LZWGC_ENTRY_SIZE));
+        r->raw_offset[ii + 1] = r->raw_offset[ii] + e.raw_len;
+    }
+
+    r->pool = pool;
+    r->states = malloc(lzwgc_pool_size(pool) * sizeof(lzwgc_chunk_state));
+    assert(0 != r->states);
+    for (uint32_t ii = 0; ii < lzwgc_pool_size(pool); ++ii)
+        lzwgc_chunk_state_init(&(r->states[ii]));
+
+    r->slot_count = (cache_chunks < 2) ? 2 : cache_chunks;
+    r->slots = calloc(r->slot_count, sizeof(lzwgc_reader_slot));
+    assert(0 != r->slots);
+    for (uint32_t ii = 0; ii < r->slot_count; ++ii)
+        r->slots[ii].chunk = r->chunk_count;
+    r->reads = 0;
+    r->hits = 0;
+    r->misses = 0;
+    return true;
+}
+
+void lzwgc_reader_fini(lzwgc_reader* r) {
+    for (uint32_t ii = 0; ii < lzwgc_pool_size(r->pool); ++ii)
+        lzwgc_chunk_state_fini(&(r->states[ii]));
+    for (uint32_t ii = 0; ii < r->slot_count; ++ii)
+        free(r->slots[ii].data);
+    free(r->states);
+    free(r->slots);
+    free(r->raw_offset);
+    r->states = 0;
+    r->slots = 0;
+    r->raw_offset = 0;
+}
+
+uint64_t lzwgc_reader_size(lzwgc_reader const* r) {
+    return r->raw_offset[r->chunk_count];
+}
+
+// the chunk holding byte `pos`, which is below the size
+static uint32_t chunk_at(lzwgc_reader const* r, uint64_t pos) {
+    uint32_t lo = 0;
+    uint32_t hi = r->chunk_count - 1;
+    while (lo < hi) {
+        uint32_t const mid = lo + ((hi - lo + 1) / 2);
+        if (r->raw_offset[mid] <= pos) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+static lzwgc_reader_slot* slot_of(lzwgc_reader* r, uint32_t chunk) {
+    for (uint32_t ii = 0; ii < r->slot_count; ++ii) {
+        if (r->slots[ii].chunk == chunk) return r->slots + ii;
+    }
+    return 0;
+}
+
+// the least recently used slot that this read is not filling; a read
+// fills at most two (its first and last chunk), and there are more
+static lzwgc_reader_slot* slot_victim(lzwgc_reader* r, lzwgc_reader_slot const* filling) {
+    lzwgc_reader_slot * victim = 0;
+    for (uint32_t ii = 0; ii < r->slot_count; ++ii) {
+        lzwgc_reader_slot * const s = r->slots + ii;
+        if ((s != filling) && ((0 == victim) || (s->stamp < victim->stamp)))
+            victim = s;
+    }
+    return victim;
+}
+
+// the part of chunk c within [pos, end) to out, which holds pos on
+static void copy_part(lzwgc_reader const* r, uint32_t c, unsigned char const* data,
+                      uint64_t pos, uint64_t end, unsigned char* out) {
+    uint64_t const lo = (r->raw_offset[c] > pos) ? r->raw_offset[c] : pos;
+    uint64_t const hi = (r->raw_offset[c + 1] < end) ? r->raw_offset[c + 1] : end;
+    memcpy(out + (lo - pos), data + (lo - r->raw_offset[c]), (size_t)(hi - lo));
+}
+
+// cached chunks are copied out first, then the missing ones are decoded
+// together, partly covered ones into the cache and the rest in place.
+bool lzwgc_reader_read(lzwgc_reader* r, uint64_t pos, unsigned char* out, size_t len) {
+    uint64_t const size = lzwgc_reader_size(r);
+    if ((pos > size) || (len > (size - pos)))
+        return false;
+    if (0 == len)
+        return true;
+
+    uint64_t const end = pos + len;
+    uint32_t const first = chunk_at(r, pos);
+    uint32_t const last = chunk_at(r, end - 1);
+    read_task * const tasks = malloc(((size_t)(last - first) + 1) * sizeof(read_task));
+    lzwgc_reader_slot * filling[2] = { 0, 0 };
+    size_t count = 0;
+    assert(0 != tasks);
+    r->reads += 1;
+
+    for (uint32_t c = first; c <= last; ++c) {
+        lzwgc_reader_slot * s = slot_of(r, c);
+        if (0 != s) {
+            s->stamp = r->reads;
+            copy_part(r, c, s->data, pos, end, out);
+            r->hits += 1;
+            continue;
+        }
+        r->misses += 1;
+        tasks[count].chunk = c;
+        if ((r->raw_offset[c] >= pos) && (r->raw_offset[c + 1] <= end)) {
+            tasks[count++].dest = out + (r->raw_offset[c] - pos);
+            continue;
+        }
+
+        size_t const raw_len = (size_t)(r->raw_offset[c + 1] - r->raw_offset[c]);
+        s = slot_victim(r, filling[0]);
+        if (s->cap < raw_len) {
+            free(s->data);
+            s->data = malloc((raw_len > 0) ? raw_len : 1);
+            s->cap = raw_len;
+            assert(0 != s->data);
+        }
+        s->chunk = c;
+        s->stamp = r->reads;
+        filling[(0 == filling[0]) ? 0 : 1] = s;
+        tasks[count++].dest = s->data;
+    }
+
+    read_job job;
+    job.r = r;
+    job.tasks = tasks;
+    if (count > 0)
+        lzwgc_pool_run(r->pool, count, read_chunk, &job);
+
+    bool ok = true;
+    for (size_t ii = 0; ii < count; ++ii) {
+        ok = ok && tasks[ii].ok;
+        for (uint32_t k = 0; k < 2; ++k) {
+            if ((0 == filling[k]) || (filling[k]->chunk != tasks[ii].chunk)) continue;
+            if (tasks[ii].ok) copy_part(r, tasks[ii].chunk, filling[k]->data, pos, end, out);
+            else filling[k]->chunk = r->chunk_count; // never keep a bad chunk
+        }
+    }
+    free(tasks);
+    return ok;
+}
@@ -0,0 +1,63 @@
+/*
+* Random access to the uncompressed bytes of an in-memory container.
+*
+* A read decodes only the chunks overlapping the range asked for, on
+* the pool's workers in parallel when it needs several. Chunks a read
+* covers only in part are kept in a small cache, the least recently
+* used going first, so a run of small reads in one region costs a copy
+* each. Chunks a read covers entirely are decoded straight into the
+* caller's buffer, unless already cached.
+*
+* Where each chunk starts in the uncompressed data is the sum of the
+* raw lengths before it in the index, worked out once at init, so any
+* container version can be read.
+*
+* A reader is used from one thread at a time; the container must stay
+* mapped until lzwgc_reader_fini.
+*/
+
+#ifndef LZWGC_READER_H
+
+#include "lzwgc_container.h"
+#include "lzwgc_pool.h"
+
+typedef struct
+{
+    uint32_t        chunk;       // chunk held, or chunk_count if none
+    uint64_t        stamp;       // read that last used it
+    unsigned char * data;
+    size_t          cap;
+} lzwgc_reader_slot;
+
+typedef struct
+{
+    lzwgc_header          hdr;
+    lzwgc_dict const    * preset;
+    unsigned char const * in;
+    unsigned char const * index;
+    uint32_t              chunk_count;
+    uint64_t            * raw_offset;  // where each chunk starts, and the total
+    lzwgc_pool          * pool;
+    lzwgc_chunk_state   * states;      // one per worker, kept across reads
+    lzwgc_reader_slot   * slots;
+    uint32_t              slot_count;
+    uint64_t              reads;
+    uint64_t              hits;        // chunks a read found cached
+    uint64_t              misses;      // chunks a read had to decode
+} lzwgc_reader;
+
+// init checks the container as lzwgc_container_parse does; false if it
+// is malformed or needs a preset other than `preset` (0 for none). The
+// cache holds `cache_chunks` chunks, at least 2, so it takes up to that
+// many times the chunk size.
+bool lzwgc_reader_init(lzwgc_reader*, lzwgc_pool*, lzwgc_dict const* preset,
+                       unsigned char const* in, size_t len, uint32_t cache_chunks);
+void lzwgc_reader_fini(lzwgc_reader*);
+uint64_t lzwgc_reader_size(lzwgc_reader const*); // uncompressed bytes
+
+// read copies `len` bytes from `pos` on. False if the range runs past
+// the end or a chunk it needs is corrupt.
+bool lzwgc_reader_read(lzwgc_reader*, uint64_t pos, unsigned char* out, size_t len);
+
+#define LZWGC_READER_H
+#endif
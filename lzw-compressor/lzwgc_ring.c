@@ -0,0 +1,98 @@
+
+
+#include "lzwgc_ring.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define ring_spin 4096 // polls before parking
+
+void lzwgc_ring_init(lzwgc_ring* r, uint32_t slots, size_t slot_size) {
+    assert((slots > 0) && (0 == (slots & (slots - 1))));
+    r->mem = malloc(slots * slot_size);
+    r->len = malloc(slots * sizeof(size_t));
+    assert((0 != r->mem) && (0 != r->len));
+    r->slot_size = slot_size;
+    r->slots = slots;
+    r->head = 0;
+    r->tail = 0;
+    r->closed = 0;
+    r->waiting = 0;
+    lzwgc_mutex_init(&(r->lock));
+    lzwgc_cond_init(&(r->wake));
+}
+
+void lzwgc_ring_fini(lzwgc_ring* r) {
+    lzwgc_cond_fini(&(r->wake));
+    lzwgc_mutex_fini(&(r->lock));
+    free(r->mem);
+    free(r->len);
+}
+
+// counters wrap; only their difference matters
+static bool can_claim(lzwgc_ring* r) {
+    return (lzwgc_atomic_load(&(r->head)) - lzwgc_atomic_load(&(r->tail))) < r->slots;
+}
+
+static bool can_peek(lzwgc_ring* r) {
+    return (lzwgc_atomic_load(&(r->head)) != lzwgc_atomic_load(&(r->tail))) ||
+        (0 != lzwgc_atomic_load(&(r->closed)));
+}
+
+// The parked side counts itself in `waiting` before checking again
+// under the lock, and the other side reads `waiting` after moving its
+// counter. With sequentially consistent atomics at least one of them
+// sees the other, so a wakeup cannot be lost. It is a count because
+// both sides may be in here at once: one woken and not yet out, the
+// other just parked.
+static void ring_wait(lzwgc_ring* r, bool (*ready)(lzwgc_ring*)) {
+    for (uint32_t ii = 0; ii < ring_spin; ++ii) {
+        if (ready(r)) return;
+    }
+    lzwgc_mutex_lock(&(r->lock));
+    lzwgc_atomic_store(&(r->waiting), lzwgc_atomic_load(&(r->waiting)) + 1);
+    while (!ready(r))
+        lzwgc_cond_wait(&(r->wake), &(r->lock));
+    lzwgc_atomic_store(&(r->waiting), lzwgc_atomic_load(&(r->waiting)) - 1);
+    lzwgc_mutex_unlock(&(r->lock));
+}
+
+static void ring_signal(lzwgc_ring* r) {
+    if (0 == lzwgc_atomic_load(&(r->waiting))) return;
+    lzwgc_mutex_lock(&(r->lock));
+    lzwgc_cond_broadcast(&(r->wake));
+    lzwgc_mutex_unlock(&(r->lock));
+}
+
+unsigned char* lzwgc_ring_claim(lzwgc_ring* r) {
+    ring_wait(r, can_claim);
+    uint32_t const ix = lzwgc_atomic_load(&(r->head)) & (r->slots - 1);
+    return r->mem + (ix * r->slot_size);
+}
+
+void lzwgc_ring_push(lzwgc_ring* r, size_t len) {
+    uint32_t const head = lzwgc_atomic_load(&(r->head));
+    assert(len <= r->slot_size);
+    r->len[head & (r->slots - 1)] = len;
+    lzwgc_atomic_store(&(r->head), head + 1);
+    ring_signal(r);
+}
+
+void lzwgc_ring_close(lzwgc_ring* r) {
+    lzwgc_atomic_store(&(r->closed), 1);
+    ring_signal(r);
+}
+
+unsigned char* lzwgc_ring_peek(lzwgc_ring* r, size_t* len) {
+    ring_wait(r, can_peek);
+    uint32_t const tail = lzwgc_atomic_load(&(r->tail));
+    if (lzwgc_atomic_load(&(r->head)) == tail)
+        return 0; // closed, and the last slot was pushed before that
+    uint32_t const ix = tail & (r->slots - 1);
+    (*len) = r->len[ix];
+    return r->mem + (ix * r->slot_size);
+}
+
+void lzwgc_ring_pop(lzwgc_ring* r) {
+    lzwgc_atomic_store(&(r->tail), lzwgc_atomic_load(&(r->tail)) + 1);
+    ring_signal(r);
+}
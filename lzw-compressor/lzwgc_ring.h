@@ -0,0 +1,46 @@
+/*
+* A single producer, single consumer ring of fixed size buffers, for
+* handing batches from one pipeline stage to the next.
+*
+* The producer claims the next free slot, fills it and pushes it; the
+* consumer peeks at the oldest filled slot, uses it in place and pops
+* it. Each side only writes its own counter, so the common case takes
+* no lock. A side that finds the ring full (or empty) spins briefly,
+* then parks on a condition variable until the other side moves.
+*/
+
+#ifndef LZWGC_RING_H
+
+#include "lzwgc_thread.h"
+#include <stddef.h>
+
+typedef struct
+{
+    unsigned char * mem;        // slots * slot_size bytes
+    size_t        * len;        // bytes used in each filled slot
+    size_t          slot_size;
+    uint32_t        slots;      // a power of two
+
+    lzwgc_atomic    head;       // slots pushed, written by the producer
+    lzwgc_atomic    tail;       // slots popped, written by the consumer
+    lzwgc_atomic    closed;     // producer will push no more
+    lzwgc_atomic    waiting;    // sides parked on wake, changed under lock
+
+    lzwgc_mutex     lock;       // only for parking
+    lzwgc_cond      wake;
+} lzwgc_ring;
+
+void lzwgc_ring_init(lzwgc_ring*, uint32_t slots, size_t slot_size);
+void lzwgc_ring_fini(lzwgc_ring*);
+
+// producer
+unsigned char* lzwgc_ring_claim(lzwgc_ring*);  // waits for a free slot
+void lzwgc_ring_push(lzwgc_ring*, size_t len); // hands over the claimed slot
+void lzwgc_ring_close(lzwgc_ring*);
+
+// consumer; peek returns 0 once the ring is closed and drained
+unsigned char* lzwgc_ring_peek(lzwgc_ring*, size_t* len);
+void lzwgc_ring_pop(lzwgc_ring*);
+
+#define LZWGC_RING_H
+#endif
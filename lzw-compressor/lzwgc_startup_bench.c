@@ -0,0 +1,187 @@
+#include "lzwgc.h"
+#include "lzwgc_container.h"
+#include "lzwgc_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define bits_min 9
+#define bits_max 24
+#define list_max 16
+
+static double now_us(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ((double)ts.tv_sec * 1e6) + ((double)ts.tv_nsec / 1e3);
+}
+
+// xorshift64, so every run sees the same input
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+// words from a fixed vocabulary, common ones far more often
+static void synth_text(unsigned char* b, size_t len) {
+    enum { vocab = 1024 };
+    static char words[vocab][10];
+    uint64_t s = 0x9e3779b97f4a7c15ull;
+    for (int w = 0; w < vocab; ++w) {
+        int const n = 2 + (int)(rnd(&s) % 8);
+        for (int k = 0; k < n; ++k) words[w][k] = (char)('a' + (rnd(&s) % 26));
+        words[w][n] = 0;
+    }
+    size_t pos = 0;
+    while (pos < len) {
+        double const u = (double)(rnd(&s) >> 11) / (double)(1ull << 53);
+        char const * w = words[(int)(vocab * u * u)];
+        while ((pos < len) && (0 != *w)) b[pos++] = (unsigned char)*w++;
+        if (pos < len) b[pos++] = ' ';
+    }
+}
+
+typedef struct {
+    double comp_us;   // per chunk
+    double dec_us;
+    bool   ok;
+} timing;
+
+// every chunk from a new state (fresh), or all from one (reused). the
+// one state is set up by an untimed chunk first, as a worker's would
+// be by its first chunk.
+static timing run(lzwgc_header const* h, unsigned char const* in, size_t chunk, uint32_t count, bool reuse,
+                  unsigned char* comp, size_t cap, unsigned char* out) {
+    lzwgc_chunk_state cs;
+    lzwgc_chunk_entry e;
+    timing t;
+    t.ok = true;
+
+    lzwgc_chunk_state_init(&cs);
+    lzwgc_chunk_compress_state(h, 0, &cs, in, chunk, comp, cap, &e);
+    double t0 = now_us();
+    for (uint32_t ii = 0; ii < count; ++ii) {
+        if (reuse) lzwgc_chunk_compress_state(h, 0, &cs, in + (ii * chunk), chunk, comp + (ii * cap), cap, &e);
+        else lzwgc_chunk_compress(h, in + (ii * chunk), chunk, comp + (ii * cap), cap, &e);
+    }
+    t.comp_us = (now_us() - t0) / count;
+
+    // the entries only differ in comp_len, which decompress needs
+    lzwgc_chunk_entry * const entries = malloc(count * sizeof(lzwgc_chunk_entry));
+    for (uint32_t ii = 0; ii < count; ++ii)
+        lzwgc_chunk_compress_state(h, 0, &cs, in + (ii * chunk), chunk, comp + (ii * cap), cap, &(entries[ii]));
+    lzwgc_chunk_decompress_state(h, 0, &cs, &(entries[0]), comp, out);
+
+    t0 = now_us();
+    for (uint32_t ii = 0; ii < count; ++ii) {
+        t.ok = t.ok && (reuse ? lzwgc_chunk_decompress_state(h, 0, &cs, &(entries[ii]), comp + (ii * cap), out + (ii * chunk))
+                              : lzwgc_chunk_decompress(h, &(entries[ii]), comp + (ii * cap), out + (ii * chunk)));
+    }
+    t.dec_us = (now_us() - t0) / count;
+    t.ok = t.ok && (0 == memcmp(in, out, count * chunk));
+
+    free(entries);
+    lzwgc_chunk_state_fini(&cs);
+    return t;
+}
+
+/** LZW-GC chunk startup benchmark:
+ *  lzwgc_startup_bench [-n chunks] [-k chunk_kb ...] [-b bits ...] [-H] [file]
+ *  Compresses and expands `chunks` (default 32) chunks of each size
+ *  (default 4 and 64 KB) at each token width (default 12, 16, 20, 24),
+ *  once starting every chunk from a new dictionary and once resetting
+ *  one dictionary between chunks, as the chunked compressors do per
+ *  worker. Reports microseconds per chunk, past the first for a reset
+ *  dictionary. Input is the file, else generated text. -H puts
+ *  dictionaries on huge pages.
+ */
+int main(int argc, char * argv[]) {
+    uint32_t count = 32;
+    uint32_t chunk_kb[list_max], widths[list_max];
+    uint32_t nchunks = 0, nwidths = 0;
+    char const * path = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        bool const more = (i + 1 < argc);
+        if (more && (0 == strcmp(argv[i], "-n"))) count = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-k")) && (nchunks < list_max)) chunk_kb[nchunks++] = atoi(argv[++i]);
+        else if (more && (0 == strcmp(argv[i], "-b")) && (nwidths < list_max)) widths[nwidths++] = atoi(argv[++i]);
+        else if (0 == strcmp(argv[i], "-H")) {
+            if (!lzwgc_huge_pages(true)) printf("no huge pages in this build; using ordinary pages\n");
+        }
+        else path = argv[i];
+    }
+    if (0 == nchunks) {
+        chunk_kb[nchunks++] = 4;
+        chunk_kb[nchunks++] = 64;
+    }
+    if (0 == nwidths) {
+        widths[nwidths++] = 12;
+        widths[nwidths++] = 16;
+        widths[nwidths++] = 20;
+        widths[nwidths++] = 24;
+    }
+    for (uint32_t w = 0; w < nwidths; ++w) {
+        if ((widths[w] < bits_min) || (widths[w] > bits_max)) {
+            printf("ERROR: Token width must be %d to %d bits.", bits_min, bits_max);
+            return -1;
+        }
+    }
+    for (uint32_t k = 0; k < nchunks; ++k) {
+        if ((0 == count) || (0 == chunk_kb[k])) {
+            printf("ERROR: Chunk count and size must be positive.");
+            return -1;
+        }
+    }
+
+    uint32_t max_kb = 0;
+    for (uint32_t k = 0; k < nchunks; ++k) {
+        if (chunk_kb[k] > max_kb) max_kb = chunk_kb[k];
+    }
+    size_t const len = (size_t)count * max_kb * 1024;
+    unsigned char * const in = malloc(len);
+    unsigned char * const out = malloc(len);
+    if ((0 == in) || (0 == out)) {
+        printf("ERROR: Out of memory.");
+        return -1;
+    }
+    lzwgc_map map;
+    if (0 != path) {
+        if (!lzwgc_map_open(&map, path, 0, 0, LZWGC_MAP_SEQUENTIAL) || (0 == map.size)) {
+            printf("ERROR: Cannot read %s.", path);
+            return -1;
+        }
+        for (size_t pos = 0; pos < len; pos += map.size) // repeated to fill
+            memcpy(in + pos, map.data, ((len - pos) < map.size) ? (len - pos) : map.size);
+        lzwgc_map_close(&map);
+    } else {
+        synth_text(in, len);
+    }
+
+    printf("bits  chunk_kb  comp fresh us  comp reset us  dec fresh us  dec reset us\n");
+    for (uint32_t w = 0; w < nwidths; ++w) {
+        for (uint32_t k = 0; k < nchunks; ++k) {
+            lzwgc_header hdr;
+            size_t const chunk = (size_t)chunk_kb[k] * 1024;
+            lzwgc_header_init(&hdr, widths[w], 0);
+            size_t const cap = lzwgc_chunk_bound(&hdr, chunk);
+            unsigned char * const comp = malloc(count * cap);
+            if (0 == comp) {
+                printf("ERROR: Out of memory.");
+                return -1;
+            }
+            timing const fresh = run(&hdr, in, chunk, count, false, comp, cap, out);
+            timing const reset = run(&hdr, in, chunk, count, true, comp, cap, out);
+            printf("%4u  %8u  %13.1f  %13.1f  %12.1f  %12.1f\n", widths[w], chunk_kb[k],
+                   fresh.comp_us, reset.comp_us, fresh.dec_us, reset.dec_us);
+            if (!fresh.ok || !reset.ok) printf("ERROR: Round trip failed.\n");
+            free(comp);
+        }
+    }
+
+    free(in);
+    free(out);
+    return 0;
+}
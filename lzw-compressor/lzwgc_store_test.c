@@ -0,0 +1,170 @@
+#include "lzwgc_pipe.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define part_len (320 << 10)
+
+// xorshift64, so every run sees the same input
+static uint64_t rnd(uint64_t* s) {
+    (*s) ^= (*s) << 13;
+    (*s) ^= (*s) >> 7;
+    (*s) ^= (*s) << 17;
+    return (*s);
+}
+
+// words from a small vocabulary, which lzw codes well
+static void text(unsigned char* b, size_t len, uint64_t* s) {
+    static char const * const words[] = {
+        "the ", "of ", "and ", "block ", "chunk ", "stored ", "stream ", "index ", "in ", "run "
+    };
+    size_t pos = 0;
+    while (pos < len) {
+        char const * w = words[rnd(s) % (sizeof(words) / sizeof(words[0]))];
+        while ((pos < len) && (0 != *w)) b[pos++] = (unsigned char)*w++;
+    }
+}
+
+// flat bytes, which lzw expands, and seven bit ones, which it expands
+// at 12 bits though they do not look incompressible
+static void noise(unsigned char* b, size_t len, uint64_t* s, unsigned char mask) {
+    for (size_t pos = 0; pos < len; ++pos)
+        b[pos] = (unsigned char)(rnd(s) >> 56) & mask;
+}
+
+typedef struct
+{
+    unsigned char const   * data;
+    size_t                  len;
+    size_t                  pos;
+    size_t                  step;      // bytes per read, to vary the batches
+} mem_source;
+
+typedef struct
+{
+    unsigned char         * data;
+    size_t                  len;
+    size_t                  cap;
+} mem_sink;
+
+static size_t source(void* ctx, unsigned char* buf, size_t cap) {
+    mem_source * const m = ctx;
+    size_t n = m->len - m->pos;
+    if (n > cap) n = cap;
+    if (n > m->step) n = m->step;
+    memcpy(buf, m->data + m->pos, n);
+    m->pos += n;
+    return n;
+}
+
+static bool sink(void* ctx, unsigned char const* data, size_t len) {
+    mem_sink * const m = ctx;
+    if ((m->cap - m->len) < len) {
+        while ((m->cap - m->len) < len) m->cap = (0 == m->cap) ? 4096 : (2 * m->cap);
+        m->data = realloc(m->data, m->cap);
+        if (0 == m->data)
+            return false;
+    }
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+    return true;
+}
+
+// check parses the container, expands every chunk, and reports whether
+// that gives `in` back within the bound: the header, index and trailer
+// on top of the input.
+static bool check(unsigned char const* in, size_t len, mem_sink const* out) {
+    lzwgc_header h;
+    lzwgc_trailer t;
+    if (!lzwgc_container_parse(out->data, out->len, &h, &t))
+        return false;
+    if (out->len > (len + LZWGC_HEADER_SIZE + LZWGC_TRAILER_SIZE + ((size_t)t.chunk_count * LZWGC_ENTRY_SIZE)))
+        return false;
+
+    unsigned char * const raw = malloc(len + 1);
+    uint64_t at = 0;
+    bool ok = (0 != raw);
+    for (uint32_t ii = 0; ok && (ii < t.chunk_count); ++ii) {
+        lzwgc_chunk_entry e;
+        lzwgc_entry_decode(&e, out->data + t.index_offset + ((size_t)ii * LZWGC_ENTRY_SIZE));
+        ok = (e.raw_len <= (len - at)) &&
+             lzwgc_chunk_decompress(&h, &e, out->data + e.offset, raw + at);
+        at += e.raw_len;
+    }
+    ok = ok && (at == len) && (0 == memcmp(in, raw, len));
+    free(raw);
+    return ok;
+}
+
+// run compresses `in` serially and through the pipe, and checks both
+static bool run(unsigned char const* in, size_t len, uint32_t bits, uint32_t flags) {
+    lzwgc_header h;
+    mem_source src = { in, len, 0, len };
+    mem_sink serial = { 0, 0, 0 };
+    mem_sink piped = { 0, 0, 0 };
+
+    lzwgc_header_init(&h, bits, flags);
+    bool ok = lzwgc_stream_compress(&h, 0, source, &src, sink, &serial);
+    src.pos = 0;
+    src.step = 40000; // blocks straddle the pipe's batches
+    ok = ok && lzwgc_pipe_compress(&h, 0, source, &src, sink, &piped);
+    ok = ok && (serial.len == piped.len) && (0 == memcmp(serial.data, piped.data, serial.len));
+    ok = ok && check(in, len, &serial);
+    free(serial.data);
+    free(piped.data);
+    return ok;
+}
+
+/** LZW-GC store test:
+ *  lzwgc_store_test
+ *  Compresses generated streams that mix text and noise, both ways
+ *  round, as well as all noise, short and empty ones, with lzwgc_stream_compress
+ *  and lzwgc_pipe_compress at 12 and 16 bits, packed, growing and entropy
+ *  coded. Checks that both write the same container, that it expands
+ *  back to the input, and that it is never more than the input plus the
+ *  header, index and trailer. Prints each failing case; exits non-zero
+ *  if there were any.
+ */
+int main(void) {
+    static uint32_t const widths[] = { 12, 16 };
+    static uint32_t const flags[] = { 0, LZWGC_FLAG_GROW, LZWGC_FLAG_ENTROPY };
+    static char const * const flag_name[] = { "packed", "growing", "entropy" };
+    static char const * const stream_name[] = {
+        "text, noise", "noise, text", "noise", "seven bit noise, text", "text", "short", "empty"
+    };
+    size_t const count = sizeof(stream_name) / sizeof(stream_name[0]);
+    unsigned char * const buf = malloc(16 * part_len);
+    uint64_t s = 0x9e3779b97f4a7c15ull;
+    uint32_t failed = 0;
+
+    if (0 == buf) {
+        printf("ERROR: Out of memory.\n");
+        return -1;
+    }
+
+    for (size_t k = 0; k < count; ++k) {
+        size_t len;
+        switch (k) {
+        case 0: text(buf, part_len, &s); noise(buf + part_len, part_len, &s, 0xff); len = 2 * part_len; break;
+        case 1: noise(buf, part_len, &s, 0xff); text(buf + part_len, part_len, &s); len = 2 * part_len; break;
+        case 2: noise(buf, part_len, &s, 0xff); len = part_len; break;
+        case 3: noise(buf, 15 * part_len, &s, 0x7f); text(buf + 15 * part_len, part_len, &s); len = 16 * part_len; break;
+        case 4: text(buf, part_len + 12345, &s); len = part_len + 12345; break;
+        case 5: text(buf, 1000, &s); len = 1000; break;
+        default: len = 0; break;
+        }
+        for (uint32_t w = 0; w < (sizeof(widths) / sizeof(widths[0])); ++w) {
+            for (uint32_t f = 0; f < (sizeof(flags) / sizeof(flags[0])); ++f) {
+                if (!run(buf, len, widths[w], flags[f])) {
+                    printf("FAILED: %s at %u bits, %s\n", stream_name[k], widths[w], flag_name[f]);
+                    failed += 1;
+                }
+            }
+        }
+    }
+    printf("%u of %u cases failed\n", failed,
+           (uint32_t)(count * (sizeof(widths) / sizeof(widths[0])) * (sizeof(flags) / sizeof(flags[0]))));
+
+    free(buf);
+    return (0 == failed) ? 0 : -1;
+}
@@ -0,0 +1,96 @@
+
+
+#include "lzwgc_thread.h"
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_main(LPVOID p) {
+    lzwgc_thread * const t = p;
+    t->fn(t->arg);
+    return 0;
+}
+
+bool lzwgc_thread_start(lzwgc_thread* t, void (*fn)(void*), void* arg) {
+    t->fn = fn;
+    t->arg = arg;
+    t->handle = CreateThread(0, 0, thread_main, t, 0, 0);
+    return (0 != t->handle);
+}
+
+void lzwgc_thread_join(lzwgc_thread* t) {
+    WaitForSingleObject(t->handle, INFINITE);
+    CloseHandle(t->handle);
+}
+
+void lzwgc_mutex_init(lzwgc_mutex* m) { InitializeCriticalSection(m); }
+void lzwgc_mutex_lock(lzwgc_mutex* m) { EnterCriticalSection(m); }
+void lzwgc_mutex_unlock(lzwgc_mutex* m) { LeaveCriticalSection(m); }
+void lzwgc_mutex_fini(lzwgc_mutex* m) { DeleteCriticalSection(m); }
+
+void lzwgc_cond_init(lzwgc_cond* c) { InitializeConditionVariable(c); }
+void lzwgc_cond_wait(lzwgc_cond* c, lzwgc_mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+void lzwgc_cond_broadcast(lzwgc_cond* c) { WakeAllConditionVariable(c); }
+void lzwgc_cond_fini(lzwgc_cond* c) { (void)c; }
+
+static BOOL CALLBACK once_main(PINIT_ONCE o, PVOID fn, PVOID* ctx) {
+    (void)o; (void)ctx;
+    ((void (*)(void))fn)();
+    return TRUE;
+}
+
+void lzwgc_call_once(lzwgc_once* o, void (*fn)(void)) {
+    InitOnceExecuteOnce(o, once_main, (PVOID)fn, 0);
+}
+
+// interlocked operations are full barriers
+uint32_t lzwgc_atomic_load(lzwgc_atomic* a) { return (uint32_t)InterlockedCompareExchange(a, 0, 0); }
+void lzwgc_atomic_store(lzwgc_atomic* a, uint32_t v) { InterlockedExchange(a, (LONG)v); }
+
+uint32_t lzwgc_cpu_count(void) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (si.dwNumberOfProcessors > 0) ? si.dwNumberOfProcessors : 1;
+}
+
+#else
+
+static void* thread_main(void* p) {
+    lzwgc_thread * const t = p;
+    t->fn(t->arg);
+    return 0;
+}
+
+bool lzwgc_thread_start(lzwgc_thread* t, void (*fn)(void*), void* arg) {
+    t->fn = fn;
+    t->arg = arg;
+    return (0 == pthread_create(&(t->handle), 0, thread_main, t));
+}
+
+void lzwgc_thread_join(lzwgc_thread* t) {
+    pthread_join(t->handle, 0);
+}
+
+void lzwgc_mutex_init(lzwgc_mutex* m) { pthread_mutex_init(m, 0); }
+void lzwgc_mutex_lock(lzwgc_mutex* m) { pthread_mutex_lock(m); }
+void lzwgc_mutex_unlock(lzwgc_mutex* m) { pthread_mutex_unlock(m); }
+void lzwgc_mutex_fini(lzwgc_mutex* m) { pthread_mutex_destroy(m); }
+
+void lzwgc_cond_init(lzwgc_cond* c) { pthread_cond_init(c, 0); }
+void lzwgc_cond_wait(lzwgc_cond* c, lzwgc_mutex* m) { pthread_cond_wait(c, m); }
+void lzwgc_cond_broadcast(lzwgc_cond* c) { pthread_cond_broadcast(c); }
+void lzwgc_cond_fini(lzwgc_cond* c) { pthread_cond_destroy(c); }
+
+void lzwgc_call_once(lzwgc_once* o, void (*fn)(void)) { pthread_once(o, fn); }
+
+uint32_t lzwgc_atomic_load(lzwgc_atomic* a) { return __atomic_load_n(a, __ATOMIC_SEQ_CST); }
+void lzwgc_atomic_store(lzwgc_atomic* a, uint32_t v) { __atomic_store_n(a, v, __ATOMIC_SEQ_CST); }
+
+uint32_t lzwgc_cpu_count(void) {
+    long const n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (uint32_t)n : 1;
+}
+
+#endif
@@ -0,0 +1,63 @@
+/*
+* Minimal threads for LZW-GC: Win32 threads on Windows, pthreads
+* elsewhere. Only what the thread pool and the pipeline need is wrapped.
+*/
+
+#ifndef LZWGC_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION   lzwgc_mutex;
+typedef CONDITION_VARIABLE lzwgc_cond;
+typedef INIT_ONCE          lzwgc_once;
+#define LZWGC_ONCE_INIT    INIT_ONCE_STATIC_INIT
+typedef LONG volatile      lzwgc_atomic;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t    lzwgc_mutex;
+typedef pthread_cond_t     lzwgc_cond;
+typedef pthread_once_t     lzwgc_once;
+#define LZWGC_ONCE_INIT    PTHREAD_ONCE_INIT
+typedef uint32_t           lzwgc_atomic;
+#endif
+
+typedef struct
+{
+#ifdef _WIN32
+    HANDLE          handle;
+#else
+    pthread_t       handle;
+#endif
+    void         (* fn)(void*);
+    void          * arg;
+} lzwgc_thread;
+
+bool lzwgc_thread_start(lzwgc_thread*, void (*fn)(void*), void* arg);
+void lzwgc_thread_join(lzwgc_thread*);
+
+void lzwgc_mutex_init(lzwgc_mutex*);
+void lzwgc_mutex_lock(lzwgc_mutex*);
+void lzwgc_mutex_unlock(lzwgc_mutex*);
+void lzwgc_mutex_fini(lzwgc_mutex*);
+
+void lzwgc_cond_init(lzwgc_cond*);
+void lzwgc_cond_wait(lzwgc_cond*, lzwgc_mutex*);
+void lzwgc_cond_broadcast(lzwgc_cond*);
+void lzwgc_cond_fini(lzwgc_cond*);
+
+// runs fn exactly once per lzwgc_once, however many threads call it;
+// the lzwgc_once must be statically initialized with LZWGC_ONCE_INIT
+void lzwgc_call_once(lzwgc_once*, void (*fn)(void));
+
+// sequentially consistent loads and stores of a 32 bit word shared
+// between threads without a lock
+uint32_t lzwgc_atomic_load(lzwgc_atomic*);
+void lzwgc_atomic_store(lzwgc_atomic*, uint32_t);
+
+uint32_t lzwgc_cpu_count(void); // online processors, at least 1
+
+#define LZWGC_THREAD_H
+#endif
@@ -0,0 +1,378 @@
+/*
+* The dictionary code that depends on its size, written once and
+* compiled by lzwgc.c for each width it specializes. Before including
+* this file, lzwgc.c defines:
+*
+*   W(name)   name of this width's copy of a function, e.g. name##_16
+*   W_SIZE    dictionary size, a constant for the specialized widths
+*             so wrap and bounds checks fold, or dict->size for others
+*   entry_t   element type of prev_token, the lru links and nothing
+*             wider than a token or an index
+*   count_t   element type of match_count and child_count
+*   entry_get(a, ix), entry_set(a, ix, v), count_get(a, ix),
+*   count_set(a, ix, v)
+*             element access for those types, which may be packed
+*
+* This file has no include guard on purpose; it undefines the macros
+* above at the end, ready for the next width.
+*/
+
+static bool W(valid)(lzwgc_dict const* dict, token_t tok) {
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    return (tok < W_SIZE) &&
+        ((tok < 256) ||
+         (tok != entry_get(prev, index_of(tok))));
+}
+
+// recency list for the lru policy, most recent first. index_of(size) is
+// the list head, so the least recent entry is lru_prev[head].
+static void W(lru_unlink)(lzwgc_dict* dict, uint32_t ix) {
+    entry_t * const next = (entry_t*)dict->lru_next;
+    entry_t * const prev = (entry_t*)dict->lru_prev;
+    uint32_t const n = entry_get(next, ix);
+    uint32_t const p = entry_get(prev, ix);
+    entry_set(next, p, n);
+    entry_set(prev, n, p);
+}
+static void W(lru_push)(lzwgc_dict* dict, uint32_t ix) {
+    entry_t * const next = (entry_t*)dict->lru_next;
+    entry_t * const prev = (entry_t*)dict->lru_prev;
+    uint32_t const head = index_of(W_SIZE);
+    uint32_t const n = entry_get(next, head);
+    entry_set(next, ix, n);
+    entry_set(prev, ix, head);
+    entry_set(prev, n, ix);
+    entry_set(next, head, ix);
+}
+
+// entries [lo, hi) to their initial state: nothing matched yet, and
+// prev_token an invalid token, so no string. under lru they queue as if
+// pushed from 0 up, so allocation starts at 0.
+static void W(clear)(lzwgc_dict* dict, uint32_t lo, uint32_t hi) {
+    entry_t * const prev = (entry_t*)dict->prev_token;
+    size_t const n = hi - lo;
+    memset((count_t*)dict->match_count + lo, 0, n * sizeof(count_t));
+    memset(dict->added_char + lo, 0, n * sizeof(unsigned char));
+    if (0 != dict->first_char) memset(dict->first_char + lo, 0, n * sizeof(unsigned char));
+    if (0 != dict->child_count) memset((count_t*)dict->child_count + lo, 0, n * sizeof(count_t));
+    for (uint32_t ii = lo; ii < hi; ++ii) {
+        entry_set(prev, ii, token(ii)); // init to invalid token
+    }
+    if (0 != dict->lru_next) {
+        entry_t * const next = (entry_t*)dict->lru_next;
+        entry_t * const back = (entry_t*)dict->lru_prev;
+        uint32_t const head = index_of(W_SIZE);
+        for (uint32_t ii = lo; ii < hi; ++ii) {
+            entry_set(next, ii, (0 == ii) ? head : (ii - 1));
+            entry_set(back, ii, ii + 1); // the last one's is head
+        }
+        entry_set(next, head, head - 1);
+        entry_set(back, head, 0);
+    }
+}
+
+static void W(update)(lzwgc_dict* dict, token_t tok) {
+    entry_t * const prev = (entry_t*)dict->prev_token;
+    count_t * const count = (count_t*)dict->match_count;
+    token_t const tok_received = tok;
+
+    // special case: this is first token; invalid history
+    bool const this_is_first_token = (dict->hist_token == W_SIZE);
+    if (this_is_first_token) {
+        dict->hist_token = tok_received;
+        return;
+    }
+
+    bool const lazy = (LZWGC_GC_LAZY == dict->gc_policy);
+    bool const lru = (LZWGC_GC_LRU == dict->gc_policy);
+
+    // increment match counts. the lazy and lru policies credit only the
+    // token itself and never walk the chain. they remember each string's
+    // first character instead; that goes stale if a prefix is collected,
+    // which costs some ratio but is the same at both ends.
+    uint32_t credited = 0;
+    if (lru) {
+        if (tok >= 256) {
+            W(lru_unlink)(dict, index_of(tok));
+            W(lru_push)(dict, index_of(tok));
+            tok = dict->first_char[index_of(tok)];
+            credited = 1;
+        }
+    } else if (lazy) {
+        if (tok >= 256) {
+            count_set(count, index_of(tok), count_get(count, index_of(tok)) + 1);
+            tok = dict->first_char[index_of(tok)];
+            credited = 1;
+        }
+    } else {
+        while (tok >= 256) {
+            uint32_t const ix = index_of(tok);
+            count_set(count, ix, count_get(count, ix) + 1);
+            tok = entry_get(prev, ix);
+            credited += 1;
+        }
+    }
+    unsigned char const first_char_of_tok_received = tok;
+    stat_add(dict, chain, credited);
+    stat_max(dict, chain_max, credited);
+
+    uint32_t const ii_max = index_of(W_SIZE);
+    uint32_t ii = dict->alloc_idx;
+    uint32_t swept = 1;
+    if (lru) {
+        // collect the least recently emitted entry. prefixes are only
+        // emitted for themselves, so an entry that others extend gets a
+        // few second chances before we orphan its children.
+        entry_t const * const back = (entry_t const*)dict->lru_prev;
+        ii = entry_get(back, ii_max);
+        for (uint32_t k = 0; (k < lru_chances) && (0 != count_get(count, ii)); ++k) {
+            W(lru_unlink)(dict, ii);
+            W(lru_push)(dict, ii);
+            ii = entry_get(back, ii_max);
+            swept += 1;
+        }
+        W(lru_unlink)(dict, ii);
+        W(lru_push)(dict, ii);
+    } else {
+        // collect an entry for allocation. under the lazy policy, a prefix
+        // is at least as useful as any string extending it, so each entry
+        // we pass lifts its prefix to its own count before being aged.
+        swept = 0;
+        while (1) {
+            ii = (ii + 1 == ii_max) ? 0 : (ii + 1);
+            swept += 1;
+            uint32_t const n = count_get(count, ii);
+            if (0 == n)
+                break;
+            if (lazy) {
+                token_t const p = entry_get(prev, ii);
+                if ((p >= 256) && (p != token(ii)) && (count_get(count, index_of(p)) < n))
+                    count_set(count, index_of(p), n);
+            }
+            count_set(count, ii, n / 2);
+        }
+    }
+    dict->alloc_idx = ii;
+    if (ii >= dict->used) dict->used = ii + 1;
+    stat_add(dict, updates, 1);
+    stat_add(dict, evictions, (entry_get(prev, ii) != token(ii)) ? 1 : 0);
+    stat_add(dict, sweep, swept);
+    stat_max(dict, sweep_max, swept);
+
+    // strings extending the entry change along with it. lru keeps child
+    // counts in match_count; other policies only when asked to.
+    count_t * const children = lru ? count : (count_t*)dict->child_count;
+    if (0 != children) {
+        token_t const p = entry_get(prev, ii);
+        if (0 != count_get(children, ii))
+            dict->orphans += 1;
+        if ((p >= 256) && (p != token(ii)))
+            count_set(children, index_of(p), count_get(children, index_of(p)) - 1);
+        token_t const h = dict->hist_token;
+        if ((h >= 256) && (h != token(ii)))
+            count_set(children, index_of(h), count_get(children, index_of(h)) + 1);
+    }
+
+    lzwgc_dict_hashtable_rem(dict, entry_get(prev, ii), dict->added_char[ii], token(ii));
+
+    entry_set(prev, ii, dict->hist_token);
+    dict->added_char[ii] = first_char_of_tok_received;
+    if (0 != dict->first_char) {
+        token_t const p = dict->hist_token;
+        dict->first_char[ii] = (p < 256) ? (unsigned char)p : dict->first_char[index_of(p)];
+    }
+    dict->hist_token = tok_received;
+
+    lzwgc_dict_hashtable_add(dict, entry_get(prev, ii), dict->added_char[ii], token(ii));
+}
+
+static uint32_t W(readrev)(lzwgc_dict const* dict, token_t tok, unsigned char* sr, uint32_t size) {
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    if (tok > W_SIZE) return 0;
+
+    uint32_t ct = 0;
+    while ((tok >= 256) && (ct < size)) {
+        uint32_t const ix = index_of(tok);
+        sr[ct++] = dict->added_char[ix];
+        tok = entry_get(prev, ix);
+    }
+    if (ct < size)
+        sr[ct++] = (unsigned char)tok;
+    return ct;
+}
+
+// the allocated entries into an empty hashtable
+static void W(rehash)(lzwgc_dict* dict) {
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    uint32_t const dyn_size = index_of(W_SIZE);
+    for (uint32_t ii = 0; ii < dyn_size; ++ii) {
+        token_t const s = entry_get(prev, ii);
+        unsigned char const c = dict->added_char[ii];
+        token_t const loc = token(ii);
+        if (s != loc)
+            lzwgc_dict_hashtable_add(dict, s, c, loc);
+    }
+}
+
+// entries [0, used) out of the hashtable
+static void W(unhash)(lzwgc_dict* dict, uint32_t used) {
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    for (uint32_t ii = 0; ii < used; ++ii)
+        lzwgc_dict_hashtable_rem(dict, entry_get(prev, ii), dict->added_char[ii], token(ii));
+}
+
+// child counts for history decode, as the entries stand
+static void W(count_children)(lzwgc_dict* dict) {
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    count_t * const children = (count_t*)dict->child_count;
+    uint32_t const dyn_size = index_of(W_SIZE);
+    memset(children, 0, dyn_size * sizeof(count_t));
+    for (uint32_t ii = 0; ii < dyn_size; ++ii) {
+        token_t const p = entry_get(prev, ii);
+        if ((p >= 256) && (p != token(ii)))
+            count_set(children, index_of(p), count_get(children, index_of(p)) + 1);
+    }
+}
+
+// same steps as lzwgc_compress_recv, but the matched token stays local
+// for the whole block and we only touch `st` at the boundaries.
+static size_t W(compress_block)(lzwgc_compress* st, unsigned char const* in, size_t count,
+                                token_t* out, size_t cap, size_t* consumed) {
+    lzwgc_dict * const dict = &(st->dict);
+    token_t s = st->matched_token;
+    size_t ii = 0;
+    size_t ct = 0;
+
+    while ((ii < count) && (ct < cap)) {
+        unsigned char const c = in[ii++];
+        token_t token_found;
+        if (lzwgc_dict_lookup(dict, s, c, &token_found)) {
+            s = token_found;
+            continue;
+        }
+        if (s < W_SIZE) {
+            out[ct++] = st->ranked ? lzwgc_dict_rank(dict, s) : s;
+            W(update)(dict, s);
+        }
+        s = (token_t)c;
+    }
+
+    st->matched_token = s;
+    st->have_output = false;
+    (*consumed) = ii;
+    return ct;
+}
+
+static size_t W(decompress_block)(lzwgc_decompress* st, token_t const* in, size_t count,
+                                  unsigned char* out, size_t cap, size_t* consumed) {
+    lzwgc_dict * const dict = &(st->dict);
+    unsigned char * const sr = st->srbuff;
+    size_t ii = 0;
+    size_t ct = 0;
+
+    while (ii < count) {
+        token_t const tok = st->ranked ? lzwgc_dict_rank(dict, in[ii]) : in[ii];
+        if (!W(valid)(dict, tok)) break; // corrupt; the caller sees the token unconsumed
+
+        if (tok < 256) {
+            if (ct == cap) break;
+            out[ct++] = (unsigned char)tok;
+        } else {
+            // the token is left unconsumed if it does not fit
+            uint32_t n = W(readrev)(dict, tok, sr, W_SIZE);
+            if (n > (cap - ct)) break;
+            while (n > 0) { out[ct++] = sr[--n]; }
+        }
+
+        W(update)(dict, tok);
+        ++ii;
+    }
+
+    st->output_count = 0;
+    (*consumed) = ii;
+    return ct;
+}
+
+// each new entry is the previous token's string plus the first byte of
+// this one, which the output already holds side by side. the record
+// stays good until some entry with children is reallocated; then we
+// cannot tell whose strings changed, so all records are dropped and
+// tokens are walked again (and re-recorded) as they come up.
+static size_t W(decompress_hist)(lzwgc_decompress* st, token_t const* in, size_t count,
+                                 unsigned char* out, size_t pos, size_t cap, size_t* consumed) {
+    lzwgc_dict * const dict = &(st->dict);
+    entry_t const * const prev = (entry_t const*)dict->prev_token;
+    unsigned char * const sr = st->srbuff;
+    size_t const start = pos;
+    size_t ii = 0;
+
+    if (0 == st->hist)
+        lzwgc_decompress_hist_init(st);
+
+    while (ii < count) {
+        token_t const tok = st->ranked ? lzwgc_dict_rank(dict, in[ii]) : in[ii];
+        if (!W(valid)(dict, tok)) break; // corrupt; the caller sees the token unconsumed
+
+        uint32_t n;
+        if (tok < 256) {
+            if (pos == cap) break;
+            n = 1;
+            out[pos] = (unsigned char)tok;
+        } else {
+            lzwgc_hist * const h = st->hist + index_of(tok);
+            n = h->len;
+            if ((0 != n) && (h->stamp == dict->orphans)) {
+                if (n > (cap - pos)) break;
+                if ((n <= 16) && ((cap - pos) >= 16))
+                    memmove(out + pos, out + h->off, 16); // one fixed size move
+                else
+                    memcpy(out + pos, out + h->off, n);
+            } else {
+                n = W(readrev)(dict, tok, sr, W_SIZE);
+                if (n > (cap - pos)) break;
+                for (uint32_t jj = 0; jj < n; ++jj) { out[pos + jj] = sr[n - 1 - jj]; }
+                h->len = n;
+                h->stamp = dict->orphans;
+            }
+            h->off = pos; // the newest copy is likeliest in cache
+        }
+
+        // the previous string must not have changed since we wrote it,
+        // and lazy or lru may add a stale first character, so check both
+        bool const first = (dict->hist_token == W_SIZE);
+        uint32_t const orphans = dict->orphans;
+        W(update)(dict, tok);
+        if (!first) {
+            uint32_t const ix = dict->alloc_idx;
+            bool const known = (st->last_stamp == dict->orphans) &&
+                (entry_get(prev, ix) != token(ix)) &&
+                (dict->added_char[ix] == out[pos]);
+            st->hist[ix].off = st->last_off;
+            st->hist[ix].len = known ? (st->last_len + 1) : 0;
+            st->hist[ix].stamp = dict->orphans;
+        }
+        if ((orphans != dict->orphans) && (0 == dict->orphans)) {
+            // stamps wrapped; forget everything rather than trust them
+            for (uint32_t jj = 0; jj < index_of(W_SIZE); ++jj) { st->hist[jj].len = 0; }
+        }
+
+        st->last_off = pos;
+        st->last_len = n;
+        st->last_stamp = orphans;
+        pos += n;
+        ++ii;
+    }
+
+    st->output_count = 0;
+    (*consumed) = ii;
+    return pos - start;
+}
+
+#undef W
+#undef W_SIZE
+#undef entry_t
+#undef count_t
+#undef entry_get
+#undef entry_set
+#undef count_get
+#undef count_set
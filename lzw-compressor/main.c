@@ -1,206 +1,407 @@
 #include "lzwgc.h"
+#include "lzwgc_container.h"
+#include "lzwgc_map.h"
+#include "lzwgc_compat.h"
 #include <stdbool.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <mpi.h>
 
 #define mpi_root 0
-
-// for now, write tokens unpacked bigendian, 2-3 octets
-void write_token(FILE* out, token_t tok, int bits) {
-    int const t16 = (tok >> 16) & 0xff;
-    int const t8 = (tok >> 8) & 0xff;
-    int const t0 = tok & 0xff;
-    if (bits > 16) fputc(t16, out);
-    fputc(t8, out);
-    fputc(t0, out);
-}
-bool read_token(FILE* in, token_t* tok, int bits) {
-    int t16 = 0;
-    int t8 = 0;
-    int t0 = 0;
-    if (bits > 16) t16 = fgetc(in);
-    t8 = fgetc(in);
-    t0 = fgetc(in);
-    (*tok) = ((t16 & 0xff) << 16) + ((t8 & 0xff) << 8) + (t0 & 0xff);
-    return (t16 != EOF) && (t8 != EOF) && (t0 != EOF);
+#define mpi_max_io (1 << 30)
+#define default_chunk_kb 4096
+
+// the queue counters, kept on the root
+#define queue_chunk 0 // next chunk to hand out
+#define queue_out   1 // compressed bytes placed so far
+
+// a work queue is a pair of counters on the root that every rank bumps
+// with MPI_Fetch_and_op, so ranks take chunks as they finish them
+// rather than a fixed share, and no rank is kept back to hand them out
+typedef struct
+{
+    MPI_Win              win;
+    unsigned long long * counter;
+} work_queue;
+
+void queue_open(work_queue* q, int pId) {
+    MPI_Aint const size = (pId == mpi_root) ? (2 * sizeof(unsigned long long)) : 0;
+    MPI_Win_allocate(size, sizeof(unsigned long long), MPI_INFO_NULL, MPI_COMM_WORLD, &(q->counter), &(q->win));
+    if (pId == mpi_root) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, mpi_root, 0, q->win);
+        q->counter[queue_chunk] = 0;
+        q->counter[queue_out] = 0;
+        MPI_Win_unlock(mpi_root, q->win);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(0, q->win);
 }
 
+// queue_add adds n to a counter and returns what it held before
+unsigned long long queue_add(work_queue* q, int which, unsigned long long n) {
+    unsigned long long old;
+    MPI_Fetch_and_op(&n, &old, MPI_UNSIGNED_LONG_LONG, mpi_root, which, MPI_SUM, q->win);
+    MPI_Win_flush(mpi_root, q->win);
+    return old;
+}
 
-// compress will process input to output.
-// this uses the knowledge that N inputs can produce at most N outputs. 
-void compress(FILE* in, FILE* out, int bits, unsigned long start, unsigned long offset) {
-    lzwgc_compress st;
-    uint32_t const dict_size = (1 << bits) - 1; // reserve top token for client
-
-    int read_buff;
-
-    fseek(in, start, SEEK_SET);
+void queue_close(work_queue* q) {
+    MPI_Win_unlock_all(q->win);
+    MPI_Win_free(&(q->win));
+}
 
-    lzwgc_compress_init(&st, dict_size);
+// compress will process one slice of input to a single chunk in memory.
+// the slice is mapped rather than read, so the compressor works on the
+// page cache directly. the chunk entry describes it for the index,
+// except for its offset. the caller frees the returned buffer; the
+// chunk state carries the dictionary over to the rank's next chunk.
+unsigned char* compress(char const* path, lzwgc_header const* hdr, lzwgc_chunk_state* cs,
+                        unsigned long long start, unsigned long long offset, lzwgc_chunk_entry* entry) {
+    lzwgc_map in;
+    unsigned char *comp_buff;
+    size_t cap;
+
+    // root checked the file opens; a failed map leaves an empty range
+    lzwgc_map_open(&in, path, start, offset, LZWGC_MAP_SEQUENTIAL | LZWGC_MAP_HUGEPAGE);
+    cap = lzwgc_chunk_bound(hdr, in.size);
+    comp_buff = malloc(cap);
+
+    lzwgc_chunk_compress_state(hdr, 0, cs, in.data, in.size, comp_buff, cap, entry);
+
+    lzwgc_map_close(&in);
+    return comp_buff;
+}
 
-    while (true) {
-        if (feof(in)) break;
-        if (offset) if ((unsigned long) ftell(in) >= start + offset) break;
+// write_at will write len bytes at offset. MPI counts are int, so
+// large buffers go out in pieces.
+bool write_at(MPI_File out, MPI_Offset offset, unsigned char const* buf, size_t len) {
+    size_t pos, n;
+    bool ok = true;
+
+    for (pos = 0; ok && (pos < len); pos += n) {
+        n = len - pos;
+        if (n > mpi_max_io) n = mpi_max_io;
+        ok = (MPI_SUCCESS == MPI_File_write_at(out, offset + pos, (void*)(buf + pos), (int)n,
+                                                MPI_BYTE, MPI_STATUS_IGNORE));
+    }
+    return ok;
+}
 
-        read_buff = fgetc(in);
-        if (read_buff == EOF) break;
-        lzwgc_compress_recv(&st, read_buff);
+// decompress will expand the chunk described by entry, writing it to
+// output at raw_offset. ranks call this for different chunks at once.
+bool decompress(FILE* in, MPI_File out, lzwgc_header const* hdr, lzwgc_chunk_state* cs,
+                lzwgc_chunk_entry const* entry, MPI_Offset raw_offset) {
+    unsigned char *read_buff, *write_buff;
+    bool ok;
+
+    // read_index checked that the chunk lies within the file, but its
+    // raw length may still be more than we can allocate
+    if ((entry->comp_len > SIZE_MAX) || (entry->raw_len > SIZE_MAX))
+        return false;
+    read_buff = malloc((size_t)entry->comp_len + 1);
+    write_buff = malloc((size_t)entry->raw_len + 1);
+
+    ok = (0 != read_buff) && (0 != write_buff) &&
+        (0 == lzwgc_fseek64(in, (int64_t)entry->offset, SEEK_SET)) &&
+        (fread(read_buff, 1, (size_t)entry->comp_len, in) == entry->comp_len) &&
+        lzwgc_chunk_decompress_state(hdr, 0, cs, entry, read_buff, write_buff) &&
+        write_at(out, raw_offset, write_buff, (size_t)entry->raw_len);
+
+    free(read_buff);
+    free(write_buff);
+    return ok;
+}
 
-        if (st.have_output) {
-            write_token(out, st.token_output, bits);
+// read_index will load the header and chunk table of a compressed file,
+// checked as lzwgc_container_parse checks any container: every chunk
+// lies between the header and the index and has a known type. the raw
+// sizes must also add up to a file we can place. the caller frees the
+// entries; 0 if the file is short, malformed, or memory runs out.
+lzwgc_chunk_entry* read_index(char const* path, lzwgc_header* hdr, uint32_t* count) {
+    lzwgc_map in;
+    lzwgc_trailer tr;
+    lzwgc_chunk_entry *entries = 0;
+    uint64_t total = 0;
+    uint32_t i;
+
+    if (!lzwgc_map_open(&in, path, 0, 0, 0))
+        return 0;
+    if (lzwgc_container_parse(in.data, in.size, hdr, &tr))
+        entries = malloc(((size_t)tr.chunk_count + 1) * sizeof(lzwgc_chunk_entry));
+    for (i = 0; (0 != entries) && (i < tr.chunk_count); i++) {
+        lzwgc_entry_decode(&entries[i], in.data + tr.index_offset + ((size_t)i * LZWGC_ENTRY_SIZE));
+        if (entries[i].raw_len > ((uint64_t)INT64_MAX - total)) {
+            free(entries);
+            entries = 0;
+        } else {
+            total += entries[i].raw_len;
         }
     }
+    lzwgc_map_close(&in);
 
-    lzwgc_compress_fini(&st);
-    if (st.have_output) {
-        write_token(out, st.token_output, bits);
-    }
-
-    write_token(out, 0xffff, bits);
+    if (0 != entries) (*count) = tr.chunk_count;
+    return entries;
 }
 
-void decompress(FILE* in, FILE* out, int bits, unsigned long start) {
-    lzwgc_decompress st;
-    uint32_t const dict_size = (1 << bits) - 1; // reserve top token for client
-    lzwgc_decompress_init(&st, dict_size);
-    token_t tok;
+// fsize is the length of a file, which may be past what a long holds
+unsigned long long fsize(FILE *f) {
+    int64_t pos, sz;
 
-    fseek(in, start, SEEK_SET);
+    pos = lzwgc_ftell64(f);
+    lzwgc_fseek64(f, 0, SEEK_END);
+    sz = lzwgc_ftell64(f);
+    lzwgc_fseek64(f, pos, SEEK_SET);
 
-    while (read_token(in, &tok, bits)) {
-        if (tok == 0xffff) break;
-        lzwgc_decompress_recv(&st, tok);
-        fwrite(st.output_chars, 1, st.output_count, out);
-    }
-    lzwgc_decompress_fini(&st);
+    return (sz > 0) ? (unsigned long long)sz : 0;
 }
 
-int marker(unsigned long *pos, FILE *in) {
-    int sum;
-    uint16_t buf;
-    unsigned long lastpos;
+// compress_job will compress a whole file as chunks of chunk_size
+// bytes, the last taking what is left. each rank takes chunks from the
+// queue until it is empty and writes each straight into the output at
+// the next free offset, so chunks land in the order they finish; the
+// index, in input order, records where each went.
+bool compress_job(char const* in_name, char const* out_name, int pId,
+                  unsigned long long size, unsigned long long chunk_size, unsigned long long* out_size) {
+    MPI_File out;
+    work_queue q;
+    lzwgc_header hdr;
+    lzwgc_chunk_state cs;
+    lzwgc_chunk_entry entry;
+    unsigned char hbuf[LZWGC_HEADER_SIZE], *mine, *ibuf = 0, *comp_buff;
+    unsigned long long const count = (size + chunk_size - 1) / chunk_size;
+    unsigned long long ii, comp_total, index_offset;
+    int ok = 1, all_ok;
+
+    lzwgc_header_init(&hdr, 16, 0);
+    MPI_File_open(MPI_COMM_WORLD, (char*)out_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &out);
+    MPI_File_set_size(out, 0);
+
+    // entries of the chunks this rank did, zero elsewhere
+    mine = calloc((size_t)count + 1, LZWGC_ENTRY_SIZE);
+    lzwgc_chunk_state_init(&cs);
+    queue_open(&q, pId);
+    while ((ii = queue_add(&q, queue_chunk, 1)) < count) {
+        unsigned long long const start = ii * chunk_size;
+        unsigned long long const len = ((size - start) < chunk_size) ? (size - start) : chunk_size;
+        comp_buff = compress(in_name, &hdr, &cs, start, len, &entry);
+        entry.offset = LZWGC_HEADER_SIZE + queue_add(&q, queue_out, entry.comp_len);
+        if ((entry.raw_len != len) || !write_at(out, entry.offset, comp_buff, (size_t)entry.comp_len)) ok = 0;
+        lzwgc_entry_encode(&entry, mine + (ii * LZWGC_ENTRY_SIZE));
+        free(comp_buff);
+    }
+    queue_close(&q);
+    lzwgc_chunk_state_fini(&cs);
+
+    // every entry is zero on all ranks but one, so or-ing them together
+    // assembles the index on the root
+    comp_total = 0;
+    for (ii = 0; ii < count; ii++) {
+        lzwgc_entry_decode(&entry, mine + (ii * LZWGC_ENTRY_SIZE));
+        comp_total += entry.comp_len;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &comp_total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (pId == mpi_root) ibuf = malloc(lzwgc_index_size((uint32_t)count));
+    MPI_Reduce(mine, ibuf, (int)(count * LZWGC_ENTRY_SIZE), MPI_BYTE, MPI_BOR, mpi_root, MPI_COMM_WORLD);
+    index_offset = LZWGC_HEADER_SIZE + comp_total;
+
+    // Root adds header and index around the chunks
+    if (pId == mpi_root) {
+        lzwgc_chunk_entry *entries = malloc(((size_t)count + 1) * sizeof(lzwgc_chunk_entry));
+        for (ii = 0; ii < count; ii++) {
+            lzwgc_entry_decode(&entries[ii], ibuf + (ii * LZWGC_ENTRY_SIZE));
+        }
+        lzwgc_index_encode(entries, (uint32_t)count, index_offset, ibuf);
+        lzwgc_header_encode(&hdr, hbuf);
+        if (!write_at(out, 0, hbuf, LZWGC_HEADER_SIZE) ||
+            !write_at(out, index_offset, ibuf, lzwgc_index_size((uint32_t)count)))
+            ok = 0;
+        free(entries);
+        free(ibuf);
+    }
+    MPI_File_close(&out);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
 
-    lastpos = ftell(in);
-    fseek(in, 0, SEEK_SET);
-    pos[0] = 0;
-    sum = 1;
+    free(mine);
+    (*out_size) = index_offset + lzwgc_index_size((uint32_t)count);
+    return (0 != all_ok);
+}
 
-    while (fread(&buf, 2, 1, in)) {
-        if (buf == 0xffff) {
-            pos[sum++] = ftell(in);
+// decompress_job will restore a whole file. the root reads the index
+// and shares it; each rank then takes chunks from a work queue and
+// expands each directly into its place in the output.
+bool decompress_job(char const* in_name, char const* out_name, int pId) {
+    FILE *in;
+    MPI_File out;
+    work_queue q;
+    lzwgc_header hdr;
+    lzwgc_chunk_state cs;
+    lzwgc_chunk_entry *entries = 0;
+    unsigned char hbuf[LZWGC_HEADER_SIZE], *ibuf;
+    MPI_Offset *raw_offset;
+    uint32_t count = 0, i;
+    int ok = 1, all_ok;
+
+    in = lzwgc_fopen(in_name, "rb");
+    if (pId == mpi_root) {
+        entries = read_index(in_name, &hdr, &count);
+        if (0 == entries) {
+            ok = 0;
+            count = 0;
         }
+        lzwgc_header_encode(&hdr, hbuf);
     }
 
-    sum--;
+    // share the index
+    MPI_Bcast(&ok, 1, MPI_INT, mpi_root, MPI_COMM_WORLD);
+    if (!ok) {
+        if (0 != in) fclose(in);
+        return false;
+    }
+    MPI_Bcast(&count, 1, MPI_UNSIGNED, mpi_root, MPI_COMM_WORLD);
+    MPI_Bcast(hbuf, LZWGC_HEADER_SIZE, MPI_BYTE, mpi_root, MPI_COMM_WORLD);
+    ibuf = malloc(lzwgc_index_size(count));
+    if (pId == mpi_root) {
+        lzwgc_index_encode(entries, count, 0, ibuf);
+    } else {
+        lzwgc_header_decode(&hdr, hbuf);
+        entries = malloc((count + 1) * sizeof(lzwgc_chunk_entry));
+    }
+    MPI_Bcast(ibuf, (int)(count * LZWGC_ENTRY_SIZE), MPI_BYTE, mpi_root, MPI_COMM_WORLD);
+
+    // chunks are stored in order, so offsets are a prefix sum
+    raw_offset = malloc((count + 1) * sizeof(MPI_Offset));
+    raw_offset[0] = 0;
+    for (i = 0; i < count; i++) {
+        lzwgc_entry_decode(&entries[i], ibuf + ((size_t)i * LZWGC_ENTRY_SIZE));
+        raw_offset[i + 1] = raw_offset[i] + (MPI_Offset)entries[i].raw_len;
+    }
 
-    fseek(in, lastpos, SEEK_SET);
+    MPI_File_open(MPI_COMM_WORLD, (char*)out_name, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &out);
+    MPI_File_set_size(out, raw_offset[count]);
 
-    return sum;
-}
+    lzwgc_chunk_state_init(&cs);
+    queue_open(&q, pId);
+    while ((i = (uint32_t)queue_add(&q, queue_chunk, 1)) < count) {
+        if ((0 == in) || !decompress(in, out, &hdr, &cs, &entries[i], raw_offset[i])) ok = 0;
+    }
+    queue_close(&q);
+    lzwgc_chunk_state_fini(&cs);
 
-int fsize(FILE *f) {
-    unsigned long pos, sz;
+    MPI_File_close(&out);
+    if (0 != in) fclose(in);
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
 
-    pos = ftell(f);
-    fseek(f, 0, SEEK_END);
-    sz = ftell(f);
-    fseek(f, pos, SEEK_SET);
+    free(entries);
+    free(ibuf);
+    free(raw_offset);
+    return (0 != all_ok);
+}
 
-    return sz;
+// parse_kb reads a chunk size in KB: decimal digits and nothing else,
+// at least 1, and few enough that the bytes fit a size_t. 0 if not.
+unsigned long long parse_kb(char const* s) {
+    char *end;
+    unsigned long long kb;
+
+    if ((s[0] < '0') || (s[0] > '9'))
+        return 0;
+    errno = 0;
+    kb = strtoull(s, &end, 10);
+    if ((0 != errno) || (0 != *end) || (kb > (SIZE_MAX >> 10)))
+        return 0;
+    return kb;
 }
 
 /** Some required arguments to run LZW compressor:
- *  lzw.exe c|d file.in file.out
+ *  lzw.exe c|d [-k chunk_kb] file.in file.out
+ *  c cuts file.in into chunks of chunk_kb (default 4096), which ranks
+ *  take in turn as they finish the last. d expands the chunks of
+ *  file.in the same way.
  */
 int main(int argc, char *argv[]) {
-    FILE *in, *out;
-    int pNum, pId, i, buf;
-    char *fname;
-    unsigned long start, offset, startsize, endsize, ratio;
-    double starttime, deltatime;
-    bool isDecompress;
+    FILE *in;
+    int pNum, pId, arg = 2;
+    unsigned long long startsize, endsize, chunk_size = (unsigned long long)default_chunk_kb << 10;
+    double starttime = 0, deltatime;
+    char const *error = 0;
+    bool isDecompress, ok;
 
     // Initialize MPI
     MPI_Init(NULL, NULL);
     MPI_Comm_rank(MPI_COMM_WORLD, &pId);
     MPI_Comm_size(MPI_COMM_WORLD, &pNum);
 
-    fname = malloc(sizeof(char) * 256);
-    
-    // Checks for legitimate arguments
-    if (pId == mpi_root) {
-        if (argc != 4) {
-            printf("ERROR: Argument required.");
-            return -1;
-        }
+    // Checks for legitimate arguments. every rank has the same ones, so
+    // all of them check and leave together; a rank that returned alone
+    // would leave the rest waiting in the first broadcast
+    if ((argc == 6) && (0 == strcmp(argv[2], "-k"))) {
+        chunk_size = parse_kb(argv[3]) << 10;
+        arg = 4;
+    }
+    if ((argc - arg) != 2) {
+        error = "ERROR: Argument required.";
+    } else if (0 == chunk_size) {
+        error = "ERROR: Chunk size must be a whole number of KB, at least 1.";
+    } else if ((argv[1][0] != 'c') && (argv[1][0] != 'd')) {
+        error = "ERROR: Job argument (c|d) required.";
+    }
+    if (0 != error) {
+        if (pId == mpi_root) printf("%s", error);
+        MPI_Finalize();
+        return -1;
+    }
+    isDecompress = (argv[1][0] == 'd');
 
-        if (argv[1][0] == 'c') {
-            isDecompress = false;
-        } else if (argv[1][0] == 'd') {
-            isDecompress = true;
+    // only the root opens the input, and tells the others how it went
+    ok = true;
+    if (pId == mpi_root) {
+        if (0 == (in = lzwgc_fopen(argv[arg], "rb"))) {
+            printf("ERROR: Cannot open file %s.", argv[arg]);
+            ok = false;
         } else {
-            printf("ERROR: Job argument (c|d) required.");
-            return -1;
-        }
-
-        if (fopen_s(&in, argv[2], "rb")) {
-            printf("ERROR: Cannot open file %s.", argv[2]);
-            return -1;
+            startsize = fsize(in);
+            fclose(in);
         }
-        startsize = fsize(in);
-        offset = startsize / pNum;
-        fclose(in);
-
         starttime = MPI_Wtime();
     }
-    
-    // Create job requirement
-    MPI_Bcast(&isDecompress, 1, MPI_BYTE, mpi_root, MPI_COMM_WORLD);
-    MPI_Bcast(&offset, 1, MPI_UNSIGNED_LONG, mpi_root, MPI_COMM_WORLD);
-    start = offset * pId;
-    sprintf_s(fname, 256, "%s.%d", argv[3], pId);
-    
-    // Start compress job
-    fopen_s(&in, argv[2], "rb");
-    fopen_s(&out, fname, "wb");
-
-    compress(in, out, 16, start, offset);
-
-    fclose(in);
-    fclose(out);
-
-    MPI_Barrier(MPI_COMM_WORLD);
-
-    // Gather written data
-    if (pId == mpi_root) {
+    MPI_Bcast(&ok, 1, MPI_BYTE, mpi_root, MPI_COMM_WORLD);
+    if (!ok) {
+        MPI_Finalize();
+        return -1;
+    }
 
-        // Write final file
-        fopen_s(&out, argv[3], "wb");
-
-        for (i = 0; i < pNum; i++) {
-            // Create temp filename
-            sprintf_s(fname, 256, "%s.%d", argv[3], i);
-            fopen_s(&in, fname, "rb");
-            while (true) {
-                buf = fgetc(in);
-                if (buf == EOF) break;
-                fputc(buf, out);
+    // Create job requirement
+    MPI_Bcast(&startsize, 1, MPI_UNSIGNED_LONG_LONG, mpi_root, MPI_COMM_WORLD);
+
+    // Start decompress job
+    if (isDecompress) {
+        ok = decompress_job(argv[arg], argv[arg + 1], pId);
+        if (pId == mpi_root) {
+            deltatime = MPI_Wtime() - starttime;
+            if (ok) {
+                printf("The decompression process took %.8fsec with %d threads.\n", deltatime, pNum);
+            } else {
+                printf("ERROR: File %s is corrupt.", argv[arg]);
             }
-            fclose(in);
-            _unlink(fname);
         }
-        endsize = ftell(out);
-        fclose(out);
+        MPI_Finalize();
+        return ok ? 0 : -1;
+    }
 
+    // Start compress job
+    ok = compress_job(argv[arg], argv[arg + 1], pId, startsize, chunk_size, &endsize);
+    if (pId == mpi_root) {
         deltatime = MPI_Wtime() - starttime;
-        ratio = (endsize * 100) / startsize;
-        printf("The compression process took %.8fsec with %d threads --> %ldb/%ldb (%d%%).\n",
-               deltatime, pNum, startsize, endsize, ratio);
+        if (ok) {
+            printf("The compression process took %.8fsec with %d threads --> %llub/%llub (%llu%%).\n",
+                   deltatime, pNum, startsize, endsize, (startsize > 0) ? (endsize * 100) / startsize : 0);
+        } else {
+            printf("ERROR: Cannot write file %s.", argv[arg + 1]);
+        }
     }
-    
-    MPI_Finalize();
 
-    return 0;
-}
\ No newline at end of file
+    MPI_Finalize();
+    return ok ? 0 : -1;
+}